@@ -0,0 +1,80 @@
+// Compares atom_hash against the old djb2 on identifier sized keys.
+//   ./nob bench && ./bin/bench/atom_hash [file.js ...]
+// Identifiers are pulled out of the given files. Without any, a synthetic
+// mix of common JS names and minifier style short names is used instead.
+#include <ctype.h>
+#include "atom.h"
+#include "bench.h"
+
+static size_t djb2(const char* str, size_t n) {
+    size_t hash = 5381;
+    for(size_t i = 0; i < n; ++i) {
+        hash = ((hash << 5) + hash) + (unsigned char)str[i];
+    }
+    return hash;
+}
+static void collect_idents(BenchInputs* idents, const char* src, size_t size) {
+    const char* end = src + size;
+    while(src < end) {
+        if(isalpha((unsigned char)*src) || *src == '_' || *src == '$') {
+            const char* start = src;
+            while(src < end && (isalnum((unsigned char)*src) || *src == '_' || *src == '$')) src++;
+            da_push(idents, ((BenchInput) { start, src - start }));
+        } else src++;
+    }
+}
+static const char* common[] = {
+    "console", "log", "toString", "prototype", "length", "push", "function", "return",
+    "this", "value", "undefined", "document", "getElementById", "addEventListener",
+    "i", "e", "t", "n", "r", "o", "a", "s", "exports", "module", "require",
+    "Object", "defineProperty", "hasOwnProperty", "__esModule", "createElement",
+};
+static void synth_idents(BenchInputs* idents, size_t n) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+    srand(69);
+    for(size_t i = 0; i < n; ++i) {
+        if(rand() % 2) {
+            const char* c = common[rand() % (sizeof(common)/sizeof(*common))];
+            da_push(idents, ((BenchInput) { c, strlen(c) }));
+            continue;
+        }
+        // Minified names are 1-3 chars, every so often there's a long one
+        size_t len = rand() % 16 == 0 ? 8 + rand() % 40 : 1 + rand() % 3;
+        char* buf = malloc(len);
+        assert(buf && "Just buy more RAM");
+        buf[0] = alphabet[rand() % 53];
+        for(size_t j = 1; j < len; ++j) buf[j] = alphabet[rand() % (sizeof(alphabet)-1)];
+        da_push(idents, ((BenchInput) { buf, len }));
+    }
+}
+#define ROUNDS 50
+static void bench(const char* name, size_t (*hash)(const char*, size_t), BenchInputs* idents, size_t bytes) {
+    double best;
+    BENCH_BEST(best, ROUNDS, idents, size_t, hash);
+    // How evenly the unique idents land in a power of 2 table,
+    // like the one AtomTable uses.
+    AtomTable uniq = { 0 };
+    for(size_t i = 0; i < idents->len; ++i) atom_table_get_or_insert_new(&uniq, idents->items[i].data, idents->items[i].len);
+    size_t mask = uniq.slots.cap-1;
+    unsigned char* used = calloc(uniq.slots.cap, 1);
+    assert(used && "Just buy more RAM");
+    size_t collisions = 0;
+    for(size_t i = 0; i < uniq.slots.cap; ++i) {
+        Atom* atom = uniq.slots.items[i];
+        if(!atom) continue;
+        size_t at = hash(atom->data, atom->len) & mask;
+        if(used[at]) collisions++;
+        used[at] = 1;
+    }
+    free(used);
+    printf("%-10s %7.2f ns/ident %7.2f GB/s  %zu/%zu unique idents collide in %zu slots\n",
+        name, best * 1e9 / idents->len, bytes / best / 1e9, collisions, uniq.len, uniq.slots.cap);
+    atom_table_destroy(&uniq);
+}
+int main(int argc, char** argv) {
+    BenchInputs idents = { 0 };
+    size_t bytes = bench_load(&idents, argc, argv, collect_idents, synth_idents, 1 << 20, "identifiers");
+    bench("djb2", djb2, &idents, bytes);
+    bench("atom_hash", atom_hash, &idents, bytes);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+// Harness shared by the benches, every bench/*.c is its own executable.
+// A bench is a list of byte slices (pulled out of files or synthesized)
+// that each contender gets timed on.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include "fileutils.h"
+
+typedef struct {
+    const char* data;
+    size_t len;
+} BenchInput;
+typedef struct {
+    BenchInput* items;
+    size_t len, cap;
+} BenchInputs;
+#include "darray.h"
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+typedef void (*BenchCollect)(BenchInputs* inputs, const char* src, size_t size);
+typedef void (*BenchSynth)(BenchInputs* inputs, size_t n);
+// Runs collect on every file given on the command line. Without any, synth makes up n inputs.
+// Prints how many inputs there are (what they are is in `what`) and returns their total size in bytes
+static size_t bench_load(BenchInputs* inputs, int argc, char** argv, BenchCollect collect, BenchSynth synth, size_t n, const char* what) {
+    for(int i = 1; i < argc; ++i) {
+        size_t size;
+        const char* src = read_entire_file(argv[i], &size);
+        if(!src) exit(1);
+        collect(inputs, src, size);
+    }
+    if(inputs->len == 0) synth(inputs, n);
+    size_t bytes = 0;
+    for(size_t i = 0; i < inputs->len; ++i) bytes += inputs->items[i].len;
+    printf("%zu %s, %.2f bytes on average\n", inputs->len, what, (double)bytes / inputs->len);
+    return bytes;
+}
+// Stores the fastest of `rounds` passes of f(data, len) over every input in best (seconds).
+// f's results get summed up as acc_type so the calls can't be thrown away
+#define BENCH_BEST(best, rounds, inputs, acc_type, f) \
+    do { \
+        volatile acc_type bench_sink_ = 0; \
+        (best) = 1e99; \
+        for(size_t bench_r_ = 0; bench_r_ < (rounds); ++bench_r_) { \
+            double bench_start_ = bench_now(); \
+            acc_type bench_acc_ = 0; \
+            for(size_t bench_i_ = 0; bench_i_ < (inputs)->len; ++bench_i_) \
+                bench_acc_ += f((inputs)->items[bench_i_].data, (inputs)->items[bench_i_].len); \
+            bench_sink_ += bench_acc_; \
+            double bench_t_ = bench_now() - bench_start_; \
+            if(bench_t_ < (best)) (best) = bench_t_; \
+        } \
+        (void)bench_sink_; \
+    } while(0)
@@ -0,0 +1,75 @@
+// Compares number_parse against strtod on decimal literals.
+//   ./nob bench && ./bin/bench/number_parse [file.js ...]
+// Literals are pulled out of the given files. Without any, a synthetic
+// mix of integers, prices, coordinates and exponent forms is used instead.
+#include <ctype.h>
+#include "number.h"
+#include "bench.h"
+
+static void collect_literals(BenchInputs* literals, const char* src, size_t size) {
+    const char* end = src + size;
+    while(src < end) {
+        // Digits inside identifiers aren't literals
+        if(isalpha((unsigned char)*src) || *src == '_' || *src == '$') {
+            while(src < end && (isalnum((unsigned char)*src) || *src == '_' || *src == '$')) src++;
+            continue;
+        }
+        if(!isdigit((unsigned char)*src)) {
+            src++;
+            continue;
+        }
+        const char* start = src;
+        while(src < end && (isdigit((unsigned char)*src) || *src == '.' || *src == 'e' || *src == 'E' ||
+              ((*src == '+' || *src == '-') && (src[-1] | 0x20) == 'e'))) src++;
+        double value;
+        if(number_parse(start, src, &value)) da_push(literals, ((BenchInput) { start, src - start }));
+    }
+}
+static void synth_literals(BenchInputs* literals, size_t n) {
+    srand(69);
+    for(size_t i = 0; i < n; ++i) {
+        char buf[64];
+        switch(rand() % 4) {
+        case 0:  snprintf(buf, sizeof(buf), "%d", rand() % 100000); break;
+        case 1:  snprintf(buf, sizeof(buf), "%d.%02d", rand() % 10000, rand() % 100); break;
+        case 2:  snprintf(buf, sizeof(buf), "%.*f", 6 + rand() % 10, (double)rand() / RAND_MAX * 180); break;
+        default: snprintf(buf, sizeof(buf), "%.*e", rand() % 17, (double)rand() / RAND_MAX * 1e10); break;
+        }
+        char* data = strdup(buf);
+        assert(data && "Just buy more RAM");
+        da_push(literals, ((BenchInput) { data, strlen(data) }));
+    }
+}
+static double parse_number_parse(const char* data, size_t len) {
+    double value = 0;
+    number_parse(data, data + len, &value);
+    return value;
+}
+// strtod needs a terminated copy, same as the fallback in number_parse
+static double parse_strtod(const char* data, size_t len) {
+    char buf[512];
+    if(len >= sizeof(buf)) len = sizeof(buf)-1;
+    memcpy(buf, data, len);
+    buf[len] = '\0';
+    return strtod(buf, NULL);
+}
+#define ROUNDS 20
+static void bench(const char* name, double (*parse)(const char*, size_t), BenchInputs* literals, size_t bytes) {
+    double best;
+    BENCH_BEST(best, ROUNDS, literals, double, parse);
+    size_t mismatches = 0;
+    for(size_t i = 0; i < literals->len; ++i) {
+        double a = parse(literals->items[i].data, literals->items[i].len);
+        double b = parse_strtod(literals->items[i].data, literals->items[i].len);
+        if(memcmp(&a, &b, sizeof(a)) != 0) mismatches++;
+    }
+    printf("%-13s %7.2f ns/literal %7.2f GB/s  %zu differ from strtod\n",
+        name, best * 1e9 / literals->len, bytes / best / 1e9, mismatches);
+}
+int main(int argc, char** argv) {
+    BenchInputs literals = { 0 };
+    size_t bytes = bench_load(&literals, argc, argv, collect_literals, synth_literals, 1 << 20, "literals");
+    bench("strtod", parse_strtod, &literals, bytes);
+    bench("number_parse", parse_number_parse, &literals, bytes);
+    return 0;
+}
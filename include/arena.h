@@ -1,19 +1,42 @@
 #pragma once
 #include <stddef.h>
+#include <stdalign.h>
 typedef struct ArenaBlock ArenaBlock;
 typedef struct Arena Arena; 
+// NOTE: a zero initialized Arena is a valid empty arena.
 struct Arena {
     ArenaBlock* first;
+    // Block allocations are bumped out of.
+    // Every block after it is unused.
+    ArenaBlock* current;
 };
 // TODO: error message on missing ARENA_MALLOC definitions?
 #define INIT_ARENA_SIZE 4096
+#define ARENA_DEFAULT_ALIGN alignof(max_align_t)
 #if !defined(ARENA_MALLOC) && !defined(ARENA_FREE)
 #   include <stdlib.h>
 #   define ARENA_MALLOC(x) malloc(x)
 #   define ARENA_FREE(x) free(x)
 #endif
 ArenaBlock* new_arena_block(size_t cap);
+// NOTE: align must be a power of 2
+void* arena_alloc_aligned(Arena* arena, size_t size, size_t align);
 void* arena_alloc(Arena* arena, size_t size);
+// Snapshot of how much of the arena is in use. Inspired by nob's temp_save/temp_rewind
+typedef struct {
+    ArenaBlock* block;
+    size_t head;
+} ArenaMark;
+ArenaMark arena_mark(Arena* arena);
+// Frees everything allocated since mark in O(1). Marks taken after it become invalid
+void arena_rewind(Arena* arena, ArenaMark mark);
+// Grows the last allocation in place when possible, otherwise copies.
+// NOTE: old allocations are never freed, only rewound or reset.
+void* arena_realloc(Arena* arena, void* old, size_t old_size, size_t new_size);
+// Makes the arena empty again but keeps its blocks around for reuse
+void arena_reset(Arena* arena);
+// Releases every block at once. The arena is empty (and reusable) afterwards
+void arena_free(Arena* arena);
 #include <stdarg.h>
 const char* vaprintf(Arena* arena, const char* fmt, va_list args);
 
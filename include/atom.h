@@ -1,25 +1,28 @@
 #pragma once
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
 typedef struct Atom Atom;
-// TODO: store the hash inside the atom
-// for MAXIMUM efficiency xD
 struct Atom {
+    size_t hash;
     size_t len;
     char data[];
 };
-typedef struct AtomTableBucket AtomTableBucket;
-struct AtomTableBucket {
-    AtomTableBucket* next;
-    Atom* atom;
-};
 typedef struct AtomTable {
+    // Open addressing. cap is always a power of 2 and NULL marks an empty slot
     struct {
-        AtomTableBucket **items;
-        size_t len;
-    } buckets;
+        Atom **items;
+        size_t cap;
+    } slots;
     size_t len;
+    // Storage for the atoms created by atom_table_get_or_insert_new
+    Arena arena;
 } AtomTable;
+// NOTE: the seed is per process and baked into every atom's hash.
+// Only ever set it before creating any atoms.
+void atom_hash_seed(uint64_t seed);
+size_t atom_hash(const char* data, size_t n);
 bool atom_table_reserve(AtomTable* map, size_t extra);
 // NOTE: does NOT check for duplicates.
 // Make sure to call atom_table_get before insert to make sure there is no such atom
@@ -29,3 +32,9 @@ Atom* atom_new(const char* data, size_t n);
 Atom* atom_new_cstr(const char* data);
 Atom* atom_table_get_or_insert_new(AtomTable* map, const char* data, size_t data_len);
 Atom* atom_table_get_or_insert_new_cstr(AtomTable* map, const char* data);
+// Same as atom_table_get_or_insert_new with the contents of an atom from some other table.
+// Its hash gets reused instead of recomputed
+Atom* atom_table_intern(AtomTable* map, const Atom* atom);
+// Frees the table along with every atom it created all at once.
+// Atoms handed to atom_table_insert are still owned by whoever made them.
+void atom_table_destroy(AtomTable* map);
@@ -21,6 +21,12 @@
         da_reserve(da, 1);\
         (da)->items[(da)->len++]=value;\
    } while(0)
+#define da_push_many(da, new_items, n) \
+   do {\
+        da_reserve(da, n);\
+        memcpy((da)->items + (da)->len, new_items, (n)*sizeof(*(da)->items));\
+        (da)->len += n;\
+   } while(0)
 #define da_insert(da, index, value) \
    do {\
         assert((int)(index) <= (int)(da)->len && "Index out of bounds");\
@@ -31,3 +37,34 @@
    } while(0)
 
 #define da_pop(da) da->items[--da->len]
+
+// Same as the above but the items live in an Arena.
+// Pairs well with arena_mark/arena_rewind on a scratch arena.
+#include "arena.h"
+#define da_reserve_arena(arena, da, extra) \
+   do {\
+      if((da)->len + extra >= (da)->cap) {\
+          size_t _da_old_cap = (da)->cap;\
+          (da)->cap = (da)->cap*2+extra;\
+          (da)->items = arena_realloc(arena, (da)->items, _da_old_cap*sizeof(*(da)->items), (da)->cap*sizeof(*(da)->items));\
+          assert((da)->items && "Ran out of memory");\
+      }\
+   } while(0)
+#define da_push_arena(arena, da, value) \
+   do {\
+        da_reserve_arena(arena, da, 1);\
+        (da)->items[(da)->len++]=value;\
+   } while(0)
+// Copies a finished darray into arena at its exact size.
+// NOTE: whatever held the old items is NOT freed
+#define da_freeze_arena(arena, da) \
+   do {\
+        void* _da_items = NULL;\
+        if((da)->len) {\
+            _da_items = arena_alloc(arena, (da)->len*sizeof(*(da)->items));\
+            assert(_da_items && "Ran out of memory");\
+            memcpy(_da_items, (da)->items, (da)->len*sizeof(*(da)->items));\
+        }\
+        (da)->items = _da_items;\
+        (da)->cap = (da)->len;\
+   } while(0)
@@ -1,6 +1,22 @@
 #pragma once
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
 // TODO: better thing that can stream into a buffer or something.
 // I don't give a fuck for now so :/
 const char* read_entire_file(const char* path, size_t* size);
-void remove_carrige_return(char* content);
+
+typedef struct {
+    const char* data;
+    size_t size;
+    // mmap'd as opposed to malloc'd
+    bool mapped;
+} FileView;
+// Maps the whole file read-only without copying it.
+// Anything that can't be mapped (pipes, ttys, "-" for stdin) gets read into memory instead.
+// NOTE: data is NOT null terminated
+bool map_entire_file(const char* path, FileView* view);
+void unmap_file(FileView* view);
+// Reads whatever is available right now (up to cap bytes) without waiting for cap to fill up.
+// Returns 0 on EOF or error
+size_t read_available(FILE* f, char* buf, size_t cap);
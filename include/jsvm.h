@@ -1,8 +1,23 @@
 #pragma once
+#include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 typedef struct Atom Atom;
+// Bytecode is a stream of 1 byte opcodes, each followed
+// by its operands encoded as unsigned LEB128 varints:
+//   JSVM_GET_GLOBAL <global cell index>
+//   JSVM_GET_MEMBER <member site index>
+//   JSVM_PUSH_STR   <const index>
+//   JSVM_CALL       <num args>
+//   JSVM_DUP
+//   JSVM_THIS
+//   JSVM_PUSH_NUM   <const index>
+//   JSVM_PUSH_INT   <zigzag encoded int32>
+//   JSVM_ADD, JSVM_SUB, JSVM_MUL, JSVM_DIV (pop rhs, pop lhs, push lhs op rhs)
+//   JSVM_PUSH_BOOL  <0 or 1>
+//   JSVM_PUSH_NULL
 enum {
     JSVM_GET_GLOBAL,
     JSVM_GET_MEMBER,
@@ -10,66 +25,277 @@ enum {
     JSVM_CALL,
     JSVM_DUP,
     JSVM_THIS,
+    JSVM_PUSH_NUM,
+    JSVM_PUSH_INT,
+    JSVM_ADD,
+    JSVM_SUB,
+    JSVM_MUL,
+    JSVM_DIV,
+    JSVM_PUSH_BOOL,
+    JSVM_PUSH_NULL,
     JSVM_INST_COUNT
 };
+typedef struct JsVmValue JsVmValue;
+typedef struct JsVmShape JsVmShape;
+// Number of shapes a member site remembers before going megamorphic
+#define JSVM_IC_POLY 4
 typedef struct {
-    uint8_t kind;
-    union {
-        Atom* atom;
-        struct { const char* data; size_t len; } push_str;
-        struct { size_t num_args; } call;
-    } as;
-} JsVmInstruction;
+    Atom* atom;
+    // Inline cache of (shape, slot) pairs seen by this site
+    JsVmShape* shapes[JSVM_IC_POLY];
+    uint32_t slots[JSVM_IC_POLY];
+    uint8_t len;
+    bool megamorphic;
+} JsVmMemberSite;
+typedef struct {
+    struct {
+        uint8_t* items;
+        size_t len, cap;
+    } code;
+    struct {
+        JsVmMemberSite* items;
+        size_t len, cap;
+    } members;
+    // Pre-built values pushed by JSVM_PUSH_STR and JSVM_PUSH_NUM.
+    // Strings in here are shared by every push and must never be mutated.
+    struct {
+        JsVmValue* items;
+        size_t len, cap;
+    } consts;
+} JsVmUnit;
+void jsvm_emit_op(JsVmUnit* unit, uint8_t op);
+void jsvm_emit_uint(JsVmUnit* unit, size_t n);
+size_t jsvm_unit_add_member(JsVmUnit* unit, Atom* atom);
+size_t jsvm_unit_add_str(JsVmUnit* unit, const char* data, size_t len);
+size_t jsvm_unit_add_number(JsVmUnit* unit, double number);
+// Emits whatever pushes number the cheapest
+void jsvm_emit_number(JsVmUnit* unit, double number);
+
 typedef struct JsVmString JsVmString;
 typedef struct JsVmObject JsVmObject; 
-typedef struct JsVmValue JsVmValue;
 typedef struct JsVmStack JsVmStack;
 // TODO: this is technically invalid.
 // In javascript strings are UTF-32
 // i.e. just array of codepoints.
 // Fucking dumbasses....
 struct JsVmString {
-    char* items;
-    size_t len, cap;
+    size_t len;
+    char data[];
 };
+JsVmString* jsvm_string_new(const char* data, size_t len);
 enum {
     JSVM_VALUE_STRING,
     JSVM_VALUE_OBJECT,
     JSVM_VALUE_FUNC,
     JSVM_VALUE_UNDEFINED,
+    JSVM_VALUE_NULL,
+    JSVM_VALUE_BOOL,
+    // Numbers are either of these two. Integers that fit stay JSVM_VALUE_INT
+    // (as long as arithmetic on them does), everything else is a double
+    JSVM_VALUE_INT,
+    JSVM_VALUE_NUMBER,
     JSVM_VALUE_COUNT
 };
+typedef void (*JsVmFunc)(JsVmValue* thiz, JsVmValue* func, JsVmStack* stack, size_t num_args);
+// Build with -DJSVM_NAN_BOXING=1 to pack every value into 8 bytes.
+// Never touch the representation directly, go through the jsvm_value_* accessors.
+#ifndef JSVM_NAN_BOXING
+#   define JSVM_NAN_BOXING 0
+#endif
+#if JSVM_NAN_BOXING
+// Anything with the top 16 bits below JSVM_NANBOX_TAG is a double
+// (NaNs get canonicalized to 0x7FF8...). Above it the top 16 bits are
+// JSVM_NANBOX_TAG + kind and the low 48 bits carry the payload
+// (int32s and bools sit in the low 32). Leaves 0xFFFF free.
+#define JSVM_NANBOX_TAG     0xFFF8ull
+#define JSVM_NANBOX_PAYLOAD 0x0000FFFFFFFFFFFFull
+static_assert(JSVM_VALUE_NUMBER == JSVM_VALUE_COUNT-1 && JSVM_VALUE_NUMBER <= 8, "Ran out of NaN-boxing tags");
+struct JsVmValue {
+    uint64_t bits;
+};
+static inline JsVmValue jsvm_value_box(uint8_t kind, uint64_t payload) {
+    // x86_64 and AArch64 user space pointers fit in 48 bits. Anything else (5-level paging, tagged pointers)
+    // would silently lose its top bits
+    assert((payload & ~JSVM_NANBOX_PAYLOAD) == 0 && "Pointer doesn't fit in a NaN-boxed value");
+    return (JsVmValue) { ((JSVM_NANBOX_TAG + kind) << 48) | (payload & JSVM_NANBOX_PAYLOAD) };
+}
+static inline uint8_t jsvm_value_kind(JsVmValue value) {
+    uint64_t top = value.bits >> 48;
+    return top < JSVM_NANBOX_TAG ? JSVM_VALUE_NUMBER : (uint8_t)(top - JSVM_NANBOX_TAG);
+}
+static inline JsVmValue jsvm_undefined(void) {
+    return jsvm_value_box(JSVM_VALUE_UNDEFINED, 0);
+}
+static inline JsVmValue jsvm_null(void) {
+    return jsvm_value_box(JSVM_VALUE_NULL, 0);
+}
+static inline JsVmValue jsvm_value_bool(bool b) {
+    return jsvm_value_box(JSVM_VALUE_BOOL, b);
+}
+static inline bool jsvm_value_as_bool(JsVmValue value) {
+    return value.bits & 1;
+}
+static inline JsVmValue jsvm_value_object(JsVmObject* object) {
+    return jsvm_value_box(JSVM_VALUE_OBJECT, (uintptr_t)object);
+}
+static inline JsVmValue jsvm_value_string(JsVmString* string) {
+    return jsvm_value_box(JSVM_VALUE_STRING, (uintptr_t)string);
+}
+static inline JsVmValue jsvm_value_func(JsVmFunc func) {
+    return jsvm_value_box(JSVM_VALUE_FUNC, (uintptr_t)func);
+}
+static inline JsVmValue jsvm_value_int(int32_t i) {
+    return jsvm_value_box(JSVM_VALUE_INT, (uint32_t)i);
+}
+static inline JsVmValue jsvm_value_number(double number) {
+    JsVmValue value;
+    if(number != number) value.bits = 0x7FF8000000000000ull;
+    else memcpy(&value.bits, &number, sizeof(number));
+    return value;
+}
+static inline JsVmObject* jsvm_value_as_object(JsVmValue value) {
+    return (JsVmObject*)(uintptr_t)(value.bits & JSVM_NANBOX_PAYLOAD);
+}
+static inline JsVmString* jsvm_value_as_string(JsVmValue value) {
+    return (JsVmString*)(uintptr_t)(value.bits & JSVM_NANBOX_PAYLOAD);
+}
+static inline JsVmFunc jsvm_value_as_func(JsVmValue value) {
+    return (JsVmFunc)(uintptr_t)(value.bits & JSVM_NANBOX_PAYLOAD);
+}
+static inline int32_t jsvm_value_as_int(JsVmValue value) {
+    return (int32_t)(uint32_t)value.bits;
+}
+static inline double jsvm_value_as_number(JsVmValue value) {
+    double number;
+    memcpy(&number, &value.bits, sizeof(number));
+    return number;
+}
+#else
 struct JsVmValue {
     uint8_t kind;
     union {
         JsVmObject* object;
-        JsVmString string;
-        struct {
-            void (*func)(JsVmValue* thiz, JsVmValue* func, JsVmStack* stack, size_t num_args);
-        } func;
+        JsVmString* string;
+        JsVmFunc func;
+        int32_t i;
+        double number;
+        bool b;
     } as;
 };
-typedef struct JsVmObjectBucket JsVmObjectBucket;
-struct JsVmObjectBucket {
-    JsVmObjectBucket* next;
+static inline uint8_t jsvm_value_kind(JsVmValue value) {
+    return value.kind;
+}
+static inline JsVmValue jsvm_undefined(void) {
+    return (JsVmValue) { .kind = JSVM_VALUE_UNDEFINED };
+}
+static inline JsVmValue jsvm_null(void) {
+    return (JsVmValue) { .kind = JSVM_VALUE_NULL };
+}
+static inline JsVmValue jsvm_value_bool(bool b) {
+    return (JsVmValue) { .kind = JSVM_VALUE_BOOL, .as.b = b };
+}
+static inline bool jsvm_value_as_bool(JsVmValue value) {
+    return value.as.b;
+}
+static inline JsVmValue jsvm_value_object(JsVmObject* object) {
+    return (JsVmValue) { .kind = JSVM_VALUE_OBJECT, .as.object = object };
+}
+static inline JsVmValue jsvm_value_string(JsVmString* string) {
+    return (JsVmValue) { .kind = JSVM_VALUE_STRING, .as.string = string };
+}
+static inline JsVmValue jsvm_value_func(JsVmFunc func) {
+    return (JsVmValue) { .kind = JSVM_VALUE_FUNC, .as.func = func };
+}
+static inline JsVmValue jsvm_value_int(int32_t i) {
+    return (JsVmValue) { .kind = JSVM_VALUE_INT, .as.i = i };
+}
+static inline JsVmValue jsvm_value_number(double number) {
+    return (JsVmValue) { .kind = JSVM_VALUE_NUMBER, .as.number = number };
+}
+static inline JsVmObject* jsvm_value_as_object(JsVmValue value) {
+    return value.as.object;
+}
+static inline JsVmString* jsvm_value_as_string(JsVmValue value) {
+    return value.as.string;
+}
+static inline JsVmFunc jsvm_value_as_func(JsVmValue value) {
+    return value.as.func;
+}
+static inline int32_t jsvm_value_as_int(JsVmValue value) {
+    return value.as.i;
+}
+static inline double jsvm_value_as_number(JsVmValue value) {
+    return value.as.number;
+}
+#endif
+static inline bool jsvm_value_is_number(JsVmValue value) {
+    uint8_t kind = jsvm_value_kind(value);
+    return kind == JSVM_VALUE_INT || kind == JSVM_VALUE_NUMBER;
+}
+// Objects with the same properties added in the same order share a shape.
+// A shape maps each property to a slot index in the object's flat slot array
+// and remembers the transitions (added properties) leading out of it.
+struct JsVmShape {
+    JsVmShape* parent;
+    // Property added by the transition into this shape. Lives in slot len-1
     Atom* key;
-    JsVmValue value;
+    size_t len;
+    struct {
+        JsVmShape** items;
+        size_t len, cap;
+    } transitions;
 };
+// Objects with more properties than this go into dictionary mode
+#define JSVM_SHAPE_MAX_PROPS 32
+typedef struct {
+    // NULL for empty entries
+    Atom* key;
+    JsVmValue value;
+} JsVmObjectEntry;
+// NOTE: a zero initialized JsVmObject is a valid empty object.
 struct JsVmObject {
+    // NULL for the empty shape
+    JsVmShape* shape;
     struct {
-        JsVmObjectBucket** items;
-        size_t len;
-    } buckets;
+        JsVmValue* items;
+        size_t len, cap;
+    } slots;
+    // Dictionary mode. Robin Hood hash table, cap is always a power of 2
+    struct {
+        JsVmObjectEntry* items;
+        size_t cap;
+    } entries;
     size_t len;
 };
-bool jsvm_object_reserve(JsVmObject* map, size_t extra);
 bool jsvm_object_insert(JsVmObject* map, Atom* name, JsVmValue value);
 
+// Every global name gets a cell that stays put for the lifetime of the globals.
+// The compiler resolves names to cell indices so JSVM_GET_GLOBAL is a single load
+// and redefining a global just overwrites its cell.
+typedef struct {
+    struct {
+        JsVmValue* items;
+        size_t len, cap;
+    } values;
+    struct {
+        Atom** items;
+        size_t len, cap;
+    } names;
+    // Open addressing index from name to cell index+1 (0 is empty)
+    struct {
+        uint32_t* items;
+        size_t cap;
+    } index;
+} JsVmGlobals;
+// Returns the cell of name, creating an undefined one if there isn't one yet
+size_t jsvm_globals_resolve(JsVmGlobals* globals, Atom* name);
+void jsvm_globals_define(JsVmGlobals* globals, Atom* name, JsVmValue value);
+
 struct JsVmStack {
     JsVmValue* items;
     size_t len, cap;
 };
-void jsvm_interpret(JsVmObject* globals, JsVmStack* stack, JsVmInstruction* inst);
+void jsvm_run(JsVmGlobals* globals, JsVmStack* stack, JsVmUnit* unit);
 
 #include <stdio.h>
 void jsvm_dump_value(FILE* sink, const JsVmValue* value);
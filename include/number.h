@@ -0,0 +1,13 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+// Decimal literals: 12, 1.5, .5, 5., 1e-3, 2.5E+10 (no sign, no hex, no separators).
+// [p, end) has to be exactly the literal, returns false if it isn't one.
+// Correctly rounded. Up to 19 significant digits take the fast paths
+// (exact double arithmetic or Eisel-Lemire), everything else goes through strtod
+bool number_parse(const char* p, const char* end, double* out);
+// Longest thing number_format writes, including the NUL
+#define NUMBER_FORMAT_MAX 32
+// Formats like JavaScript's Number.prototype.toString(): shortest digits that round trip,
+// no exponent between 1e-7 and 1e21. Returns the length
+size_t number_format(double value, char buf[NUMBER_FORMAT_MAX]);
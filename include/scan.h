@@ -0,0 +1,14 @@
+#pragma once
+// Vectorized byte scanners for the lexer.
+// Each returns the first byte in [p, end) that does NOT belong to the run (or end).
+// Picks AVX2, SSE2 or plain C on first use depending on what the CPU supports.
+
+// Runs of ' ', '\t', '\n', '\v', '\f', '\r'
+const char* scan_skip_space(const char* p, const char* end);
+// Runs of [A-Za-z0-9_]
+const char* scan_skip_word(const char* p, const char* end);
+// Runs of string literal bytes that can be copied as is.
+// Stops at '"', '\\', '\n', '\r' and anything >= 0x80
+const char* scan_skip_str(const char* p, const char* end);
+// Everything up to the next '\n' or '\r'
+const char* scan_skip_line(const char* p, const char* end);
@@ -1,6 +1,194 @@
 #define NOB_IMPLEMENTATION
 #define NOB_STRIP_PREFIX
 #include "nob.h"
+#include <stdint.h>
+// Atoms every run needs. They get baked into a generated header so they're
+// static objects the lexer and compiler can point at directly. js_atoms_init
+// still hashes them and puts them in the AtomTable at startup.
+// Reserved words only. Contextual ones (let, static, yield, async, await, of, get, set)
+// are plain identifiers in sloppy scripts, they're builtin atoms the parser compares against
+static const char* keywords[] = {
+    "break", "case", "catch", "class", "const", "continue", "debugger", "default",
+    "delete", "do", "else", "enum", "export", "extends", "false", "finally",
+    "for", "function", "if", "import", "in", "instanceof", "new",
+    "null", "return", "super", "switch", "this", "throw", "true",
+    "try", "typeof", "var", "void", "while", "with",
+};
+static const char* builtin_atoms[] = {
+    "console", "log", "toString",
+    "let", "static", "yield", "async", "await", "of", "get", "set",
+};
+// Has to match the hash in js_keyword_lookup in src/main.c
+static size_t keyword_hash(const char* kw, size_t a, size_t b, size_t slots) {
+    size_t len = strlen(kw);
+    return ((unsigned char)kw[0]*a + (unsigned char)kw[len-1]*b + len) & (slots-1);
+}
+static void append_upper(String_Builder* sb, const char* s) {
+    for(; *s; ++s) da_append(sb, toupper((unsigned char)*s));
+}
+// Generated files are only touched when their contents change so they don't trigger rebuilds
+static bool write_generated(const char* path, const String_Builder* sb) {
+    String_Builder old = { 0 };
+    bool same = file_exists(path) == 1 && read_entire_file(path, &old) &&
+        old.count == sb->count && memcmp(old.items, sb->items, sb->count) == 0;
+    bool ok = same || write_entire_file(path, sb->items, sb->count);
+    sb_free(old);
+    return ok;
+}
+// Writes <gen_dir>/js_atoms.h: the X lists of keywords and builtin atoms
+// plus a perfect hash table mapping keywords to their index
+static bool generate_atoms(const char* gen_dir) {
+    size_t nkeywords = ARRAY_LEN(keywords);
+    size_t slots = 32, a = 0, b = 0;
+    uint8_t table[256];
+    for(;;) {
+        if(slots > sizeof(table)) {
+            nob_log(NOB_ERROR, "Could not find a perfect hash for the keywords");
+            return false;
+        }
+        for(a = 1; a < 256; ++a) {
+            for(b = 1; b < 256; ++b) {
+                memset(table, 0, slots);
+                size_t i = 0;
+                for(; i < nkeywords; ++i) {
+                    size_t h = keyword_hash(keywords[i], a, b, slots);
+                    if(table[h]) break;
+                    table[h] = i+1;
+                }
+                if(i == nkeywords) goto FOUND;
+            }
+        }
+        slots *= 2;
+    }
+FOUND:;
+    size_t min_len = SIZE_MAX, max_len = 0;
+    for(size_t i = 0; i < nkeywords; ++i) {
+        size_t len = strlen(keywords[i]);
+        if(len < min_len) min_len = len;
+        if(len > max_len) max_len = len;
+    }
+    String_Builder sb = { 0 };
+    sb_appendf(&sb, "// Generated by nob.c, do not edit\n");
+    sb_appendf(&sb, "#pragma once\n");
+    sb_appendf(&sb, "// X(NAME, name)\n");
+    sb_appendf(&sb, "#define JS_KEYWORDS \\\n");
+    for(size_t i = 0; i < nkeywords; ++i) {
+        sb_appendf(&sb, "    X(");
+        append_upper(&sb, keywords[i]);
+        sb_appendf(&sb, ", %s) \\\n", keywords[i]);
+    }
+    sb_appendf(&sb, "\n#define JS_KEYWORD_COUNT %zu\n", nkeywords);
+    sb_appendf(&sb, "#define JS_BUILTIN_ATOMS \\\n");
+    for(size_t i = 0; i < ARRAY_LEN(builtin_atoms); ++i) {
+        sb_appendf(&sb, "    X(");
+        append_upper(&sb, builtin_atoms[i]);
+        sb_appendf(&sb, ", %s) \\\n", builtin_atoms[i]);
+    }
+    sb_appendf(&sb, "\n");
+    sb_appendf(&sb, "#define JS_KEYWORD_MIN_LEN %zu\n", min_len);
+    sb_appendf(&sb, "#define JS_KEYWORD_MAX_LEN %zu\n", max_len);
+    sb_appendf(&sb, "#define JS_KEYWORD_HASH_A %zu\n", a);
+    sb_appendf(&sb, "#define JS_KEYWORD_HASH_B %zu\n", b);
+    sb_appendf(&sb, "#define JS_KEYWORD_SLOTS %zu\n", slots);
+    sb_appendf(&sb, "// Keyword index + 1, 0 for no keyword\n");
+    sb_appendf(&sb, "static const unsigned char js_keyword_slots[JS_KEYWORD_SLOTS] = {");
+    for(size_t i = 0; i < slots; ++i) {
+        sb_appendf(&sb, "%s%d,", i % 16 == 0 ? "\n    " : " ", table[i]);
+    }
+    sb_appendf(&sb, "\n};\n");
+
+    bool ok = write_generated(temp_sprintf("%s/js_atoms.h", gen_dir), &sb);
+    sb_free(sb);
+    return ok;
+}
+// Just enough bignum for the power of 10 table. Little endian 32 bit limbs
+#define BIG_LIMBS 32
+typedef struct {
+    uint32_t limbs[BIG_LIMBS];
+} Big;
+static void big_mul_small(Big* x, uint32_t m) {
+    uint64_t carry = 0;
+    for(size_t i = 0; i < BIG_LIMBS; ++i) {
+        carry += (uint64_t)x->limbs[i] * m;
+        x->limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    assert(carry == 0 && "Bump BIG_LIMBS");
+}
+static void big_shl1(Big* x) {
+    assert(!(x->limbs[BIG_LIMBS-1] >> 31) && "Bump BIG_LIMBS");
+    for(size_t i = BIG_LIMBS-1; i > 0; --i) x->limbs[i] = x->limbs[i] << 1 | x->limbs[i-1] >> 31;
+    x->limbs[0] <<= 1;
+}
+static int big_cmp(const Big* a, const Big* b) {
+    for(size_t i = BIG_LIMBS; i > 0; --i) {
+        if(a->limbs[i-1] != b->limbs[i-1]) return a->limbs[i-1] < b->limbs[i-1] ? -1 : 1;
+    }
+    return 0;
+}
+static void big_sub(Big* a, const Big* b) {
+    uint64_t borrow = 0;
+    for(size_t i = 0; i < BIG_LIMBS; ++i) {
+        uint64_t d = (uint64_t)a->limbs[i] - b->limbs[i] - borrow;
+        a->limbs[i] = (uint32_t)d;
+        borrow = d >> 63;
+    }
+}
+static bool big_bit(const Big* x, size_t i) {
+    return (x->limbs[i / 32] >> (i % 32)) & 1;
+}
+static size_t big_bits(const Big* x) {
+    for(size_t i = BIG_LIMBS*32; i > 0; --i) {
+        if(big_bit(x, i-1)) return i;
+    }
+    return 0;
+}
+// The mantissa of 10^q as 128 bits in [2^127, 2^128), rounded down.
+// 10^q = 5^q * 2^q, so that's just 5^q (or 1/5^-q) scaled by a power of 2
+static void pow10_mantissa(int q, uint64_t out[2]) {
+    Big p = { .limbs = { 1 } };
+    for(int i = 0; i < (q < 0 ? -q : q); ++i) big_mul_small(&p, 5);
+    size_t bits = big_bits(&p);
+    out[0] = out[1] = 0;
+    if(q >= 0) {
+        for(size_t i = 0; i < 128 && i < bits; ++i) {
+            if(big_bit(&p, bits-1-i)) out[i / 64] |= 1ull << (63 - i % 64);
+        }
+        return;
+    }
+    // floor(2^(bits+127) / 5^-q) has exactly 128 bits. Plain long division
+    Big r = { 0 };
+    for(size_t i = bits+128; i > 0; --i) {
+        big_shl1(&r);
+        if(i == bits+128) r.limbs[0] |= 1;
+        bool one = big_cmp(&r, &p) >= 0;
+        if(one) big_sub(&r, &p);
+        out[0] = out[0] << 1 | out[1] >> 63;
+        out[1] = out[1] << 1 | one;
+    }
+}
+// Writes <gen_dir>/number_pow10.h: the table the Eisel-Lemire path of number_parse multiplies with.
+// Covers every exponent a double with a 19 digit mantissa can land on without under/overflowing
+static bool generate_pow10(const char* gen_dir) {
+    const int min = -342, max = 308;
+    String_Builder sb = { 0 };
+    sb_appendf(&sb, "// Generated by nob.c, do not edit\n");
+    sb_appendf(&sb, "#pragma once\n");
+    sb_appendf(&sb, "#include <stdint.h>\n");
+    sb_appendf(&sb, "#define NUMBER_POW10_MIN (%d)\n", min);
+    sb_appendf(&sb, "#define NUMBER_POW10_MAX %d\n", max);
+    sb_appendf(&sb, "// {hi, lo} of 10^q scaled into [2^127, 2^128), rounded down. Indexed by q - NUMBER_POW10_MIN\n");
+    sb_appendf(&sb, "static const uint64_t number_pow10[%d][2] = {\n", max - min + 1);
+    for(int q = min; q <= max; ++q) {
+        uint64_t m[2];
+        pow10_mantissa(q, m);
+        sb_appendf(&sb, "    { 0x%016llXull, 0x%016llXull }, // 1e%d\n", (unsigned long long)m[0], (unsigned long long)m[1], q);
+    }
+    sb_appendf(&sb, "};\n");
+    bool ok = write_generated(temp_sprintf("%s/number_pow10.h", gen_dir), &sb);
+    sb_free(sb);
+    return ok;
+}
 static bool walk_directory(
     File_Paths* dirs,
     File_Paths* c_sources,
@@ -38,6 +226,17 @@ static bool walk_directory(
 }
 int main(int argc, char** argv) {
     NOB_GO_REBUILD_URSELF(argc, argv);
+    const char* program = shift(argv, argc);
+    bool build_bench = false;
+    while(argc) {
+        const char* arg = shift(argv, argc);
+        if(strcmp(arg, "bench") == 0) build_bench = true;
+        else {
+            nob_log(NOB_ERROR, "Unknown argument `%s`", arg);
+            nob_log(NOB_INFO, "Usage: %s [bench]", program);
+            return 1;
+        }
+    }
     char* cc = getenv("CC");
     // TODO: automatic checks for the compiler 
     // available on the system. Maybe default to clang on bimbows
@@ -47,9 +246,16 @@ int main(int argc, char** argv) {
     if(!bindir) bindir = "bin";
     setenv("BINDIR", bindir, 0);
     if(!mkdir_if_not_exists(bindir)) return 1;
+    // NOTE: changing this doesn't trigger a rebuild.
+    // Use a separate BINDIR (or delete it) when toggling.
+    bool nan_boxing = getenv("JSVM_NAN_BOXING") && strcmp(getenv("JSVM_NAN_BOXING"), "0") != 0;
 
     // Building Raylib
     Cmd cmd = { 0 };
+    const char* gen_dir = temp_sprintf("%s/gen", bindir);
+    if(!mkdir_if_not_exists(gen_dir)) return 1;
+    if(!generate_atoms(gen_dir)) return 1;
+    if(!generate_pow10(gen_dir)) return 1;
     if(!mkdir_if_not_exists(temp_sprintf("%s/jesse", bindir))) return 1;
 
 
@@ -82,7 +288,10 @@ int main(int argc, char** argv) {
         // Include directories 
         cmd_append(&cmd,
             "-I", "include",
+            "-I", gen_dir,
         );
+        // Build flags
+        if(nan_boxing) cmd_append(&cmd, "-DJSVM_NAN_BOXING=1");
         // Actual compilation
         cmd_append(&cmd,
             "-MD", "-O1", "-g", "-c",
@@ -96,7 +305,23 @@ int main(int argc, char** argv) {
         cmd_append(&cmd, cc, "-o", exe);
         da_append_many(&cmd, objs.items, objs.count);
         // Vendor libraries we link with
-        cmd_append(&cmd, "-lm");
+        cmd_append(&cmd, "-lm", "-lpthread");
         if(!cmd_run_sync_and_reset(&cmd)) return 1;
     }
+    if(build_bench) {
+        // Every bench/*.c is its own executable linked against everything but main
+        File_Paths bench_dirs = { 0 }, bench_sources = { 0 };
+        if(!walk_directory(&bench_dirs, &bench_sources, "bench")) return 1;
+        if(!mkdir_if_not_exists(temp_sprintf("%s/bench", bindir))) return 1;
+        for(size_t i = 0; i < bench_sources.count; ++i) {
+            const char* src = bench_sources.items[i];
+            const char* out = temp_sprintf("%s/bench/%.*s", bindir, (int)(strlen(src + 6)-2), src + 6);
+            cmd_append(&cmd, cc, "-Wall", "-Wextra", "-Wno-unused-function", "-I", "include", "-I", gen_dir, "-O2", "-g", "-o", out, src);
+            for(size_t j = 0; j < objs.count; ++j) {
+                if(strcmp(path_name(objs.items[j]), "main.o") != 0) da_append(&cmd, objs.items[j]);
+            }
+            cmd_append(&cmd, "-lm");
+            if(!cmd_run_sync_and_reset(&cmd)) return 1;
+        }
+    }
 }
@@ -1,4 +1,5 @@
 #include "arena.h"
+#include <stdint.h>
 typedef struct ArenaBlock {
     struct ArenaBlock* next;
     size_t head;
@@ -8,33 +9,85 @@ typedef struct ArenaBlock {
 
 ArenaBlock* new_arena_block(size_t cap) {
     ArenaBlock* block = (ArenaBlock*)ARENA_MALLOC(sizeof(*block) + cap);
+    if(!block) return NULL;
     block->next = NULL;
     block->head = 0;
     block->cap = cap;
     return block;
 }
+// Returns NULL if the allocation doesn't fit into block
+static inline void* arena_block_bump(ArenaBlock* block, size_t size, size_t align) {
+    uintptr_t at = (uintptr_t)(block->data + block->head);
+    size_t pad = ((at + align - 1) & ~(uintptr_t)(align - 1)) - at;
+    if(block->cap - block->head < pad || block->cap - block->head - pad < size) return NULL;
+    block->head += pad + size;
+    return (void*)(at + pad);
+}
+void* arena_alloc_aligned(Arena* arena, size_t size, size_t align) {
+    void* at;
+    if(arena->current) {
+        if((at = arena_block_bump(arena->current, size, align))) return at;
+        // Blocks left behind from an arena_reset
+        while(arena->current->next) {
+            arena->current = arena->current->next;
+            arena->current->head = 0;
+            if((at = arena_block_bump(arena->current, size, align))) return at;
+        }
+    }
+    // Grow geometrically so the number of blocks stays logarithmic
+    size_t cap = arena->current ? arena->current->cap * 2 : INIT_ARENA_SIZE;
+    if(cap < size + align) cap = size + align;
+    ArenaBlock* block = new_arena_block(cap);
+    if(!block) return NULL;
+    if(arena->current) arena->current->next = block;
+    else arena->first = block;
+    arena->current = block;
+    return arena_block_bump(block, size, align);
+}
 void* arena_alloc(Arena* arena, size_t size) {
-    if(!arena->first) {
-        arena->first = new_arena_block(INIT_ARENA_SIZE < size ? size : INIT_ARENA_SIZE);
-        void* at = arena->first->data + arena->first->head;
-        arena->first->head+=size;
-        return at;
+    return arena_alloc_aligned(arena, size, ARENA_DEFAULT_ALIGN);
+}
+#include <string.h>
+void* arena_realloc(Arena* arena, void* old, size_t old_size, size_t new_size) {
+    ArenaBlock* block = arena->current;
+    if(old && block && (char*)old + old_size == block->data + block->head) {
+        size_t start = (char*)old - block->data;
+        if(block->cap - start >= new_size) {
+            block->head = start + new_size;
+            return old;
+        }
+    }
+    void* at = arena_alloc(arena, new_size);
+    if(at && old) memcpy(at, old, old_size < new_size ? old_size : new_size);
+    return at;
+}
+ArenaMark arena_mark(Arena* arena) {
+    return (ArenaMark) {
+        arena->current,
+        arena->current ? arena->current->head : 0
+    };
+}
+void arena_rewind(Arena* arena, ArenaMark mark) {
+    if(!mark.block) {
+        arena_reset(arena);
+        return;
     }
+    arena->current = mark.block;
+    arena->current->head = mark.head;
+}
+void arena_reset(Arena* arena) {
+    arena->current = arena->first;
+    if(arena->current) arena->current->head = 0;
+}
+void arena_free(Arena* arena) {
     ArenaBlock* block = arena->first;
-    ArenaBlock* prev = block;
     while(block) {
-        if(block->cap-block->head >= size) {
-            void* at = block->data + block->head;
-            block->head+=size;
-            return at;
-        }
-        prev = block;
-        block = block->next;
+        ArenaBlock* next = block->next;
+        ARENA_FREE(block);
+        block = next;
     }
-    prev->next = new_arena_block(INIT_ARENA_SIZE < size ? size : INIT_ARENA_SIZE);
-    void* at = prev->next->data + prev->next->head;
-    prev->next->head+=size;
-    return at;
+    arena->first = NULL;
+    arena->current = NULL;
 }
 
 #include <stdio.h>
@@ -1,5 +1,6 @@
 #include <atom.h>
 #include <string.h>
+#include <stdint.h>
 
 #if 0
 # define AT_ASSERT(a) (void)(a);
@@ -12,77 +13,162 @@
 #define ATOM_TABLE_ALLOC malloc
 #define ATOM_TABLE_DEALLOC(ptr, n) free(ptr)
 
-#define ATOM_TABLE_BUCKET_ALLOC   malloc
-#define ATOM_TABLE_BUCKET_DEALLOC free
-static size_t djb2(const char* str, size_t n) {
-    size_t hash = 5381;
-    for(size_t i = 0; i < n; ++i) {
-        hash = ((hash << 5) + hash) + (unsigned char)str[i];
+// wyhash-style word-at-a-time hash.
+// Short identifiers (the vast majority) are read as a couple of overlapping
+// words, long ones get chewed through in 3 independent lanes so the multiplies
+// can overlap.
+#define ATOM_P0 0xa0761d6478bd642full
+#define ATOM_P1 0xe7037ed1a0b428dbull
+#define ATOM_P2 0x8ebc6af09c88c6e3ull
+#define ATOM_P3 0x589965cc75374cc3ull
+static uint64_t atom_seed = 0;
+void atom_hash_seed(uint64_t seed) {
+    atom_seed = seed;
+}
+static inline void atom_mum(uint64_t* a, uint64_t* b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+static inline uint64_t atom_mix(uint64_t a, uint64_t b) {
+    atom_mum(&a, &b);
+    return a ^ b;
+}
+static inline uint64_t atom_read64(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+static inline uint64_t atom_read32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+size_t atom_hash(const char* data, size_t n) {
+    const char* p = data;
+    uint64_t seed = atom_seed ^ atom_mix(atom_seed ^ ATOM_P0, ATOM_P1);
+    uint64_t a, b;
+    if(n <= 16) {
+        if(n >= 4) {
+            size_t mid = (n >> 3) << 2;
+            a = (atom_read32(p) << 32) | atom_read32(p + mid);
+            b = (atom_read32(p + n - 4) << 32) | atom_read32(p + n - 4 - mid);
+        } else if(n > 0) {
+            const unsigned char* u = (const unsigned char*)p;
+            a = ((uint64_t)u[0] << 16) | ((uint64_t)u[n >> 1] << 8) | u[n - 1];
+            b = 0;
+        } else a = b = 0;
+    } else {
+        size_t i = n;
+        if(i > 48) {
+            uint64_t s1 = seed, s2 = seed;
+            do {
+                seed = atom_mix(atom_read64(p)      ^ ATOM_P1, atom_read64(p + 8)  ^ seed);
+                s1   = atom_mix(atom_read64(p + 16) ^ ATOM_P2, atom_read64(p + 24) ^ s1);
+                s2   = atom_mix(atom_read64(p + 32) ^ ATOM_P3, atom_read64(p + 40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= s1 ^ s2;
+        }
+        while(i > 16) {
+            seed = atom_mix(atom_read64(p) ^ ATOM_P1, atom_read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = atom_read64(p + i - 16);
+        b = atom_read64(p + i - 8);
     }
-    return hash;
+    a ^= ATOM_P1;
+    b ^= seed;
+    atom_mum(&a, &b);
+    return (size_t)atom_mix(a ^ ATOM_P0 ^ n, b ^ ATOM_P1);
 }
 bool atom_table_reserve(AtomTable* map, size_t extra) {
-    if(map->len + extra > map->buckets.len) {
-        size_t ncap = map->buckets.len*2 + extra;
-        AtomTableBucket** newbuckets = ATOM_TABLE_ALLOC(sizeof(*newbuckets)*ncap);
-        if(!newbuckets) return false;
-        memset(newbuckets, 0, sizeof(*newbuckets) * ncap);
-        for(size_t i = 0; i < map->buckets.len; ++i) {
-            AtomTableBucket* oldbucket = map->buckets.items[i];
-            while(oldbucket) {
-                AtomTableBucket* next = oldbucket->next;
-                size_t hash = (djb2(oldbucket->atom->data, oldbucket->atom->len)) % ncap;
-                AtomTableBucket* newbucket = newbuckets[hash];
-                oldbucket->next = newbucket;
-                newbuckets[hash] = oldbucket;
-                oldbucket = next;
-            }
+    // Keep the load factor under 1/2
+    if((map->len + extra) * 2 > map->slots.cap) {
+        size_t ncap = map->slots.cap ? map->slots.cap : 64;
+        while((map->len + extra) * 2 > ncap) ncap *= 2;
+        Atom** newslots = ATOM_TABLE_ALLOC(sizeof(*newslots)*ncap);
+        if(!newslots) return false;
+        memset(newslots, 0, sizeof(*newslots) * ncap);
+        for(size_t i = 0; i < map->slots.cap; ++i) {
+            Atom* atom = map->slots.items[i];
+            if(!atom) continue;
+            size_t at = atom->hash & (ncap-1);
+            while(newslots[at]) at = (at+1) & (ncap-1);
+            newslots[at] = atom;
         }
-        ATOM_TABLE_DEALLOC(map->buckets.items, map->buckets.cap * sizeof(*map->buckets.items));
-        map->buckets.items = newbuckets;
-        map->buckets.len = ncap;
+        ATOM_TABLE_DEALLOC(map->slots.items, map->slots.cap * sizeof(*map->slots.items));
+        map->slots.items = newslots;
+        map->slots.cap = ncap;
     }
     return true;
 }
 bool atom_table_insert(AtomTable* map, Atom* atom) {
     if(!atom_table_reserve(map, 1)) return false;
-    size_t hash = (djb2(atom->data, atom->len)) % map->buckets.len;
-    AtomTableBucket* into = map->buckets.items[hash];
-    AtomTableBucket* bucket = ATOM_TABLE_BUCKET_ALLOC(sizeof(AtomTableBucket));
-    if(!bucket) return false;
-    bucket->next = into;
-    bucket->atom = atom;
-    map->buckets.items[hash] = bucket;
+    size_t mask = map->slots.cap-1;
+    size_t at = atom->hash & mask;
+    while(map->slots.items[at]) at = (at+1) & mask;
+    map->slots.items[at] = atom;
     map->len++;
     return true;
 }
-Atom* atom_table_get(AtomTable* map, const char* data, size_t data_len) {
+static Atom* atom_table_get_hashed(AtomTable* map, const char* data, size_t data_len, size_t hash) {
     if(map->len == 0) return NULL;
-    assert(map->buckets.len > 0);
-    size_t hash = djb2(data, data_len) % map->buckets.len;
-    AtomTableBucket* bucket = map->buckets.items[hash];
-    while(bucket) {
-        if(bucket->atom->len == data_len && memcmp(bucket->atom->data, data, data_len) == 0) return bucket->atom;
-        bucket = bucket->next;
+    AT_ASSERT(map->slots.cap > 0);
+    size_t mask = map->slots.cap-1;
+    size_t at = hash & mask;
+    Atom* atom;
+    while((atom = map->slots.items[at])) {
+        if(atom->hash == hash && atom->len == data_len && memcmp(atom->data, data, data_len) == 0) return atom;
+        at = (at+1) & mask;
     }
     return NULL;
 }
+Atom* atom_table_get(AtomTable* map, const char* data, size_t data_len) {
+    return atom_table_get_hashed(map, data, data_len, atom_hash(data, data_len));
+}
 
-Atom* atom_new(const char* data, size_t n) {
-    Atom* atom = malloc(sizeof(*atom) + n + 1);
-    assert(atom && "Just buy more RAM");
+static void atom_init(Atom* atom, const char* data, size_t n, size_t hash) {
+    atom->hash = hash;
     atom->len = n;
     memcpy(atom->data, data, n);
     atom->data[n] = '\0';
+}
+static Atom* atom_new_hashed(const char* data, size_t n, size_t hash) {
+    Atom* atom = malloc(sizeof(*atom) + n + 1);
+    assert(atom && "Just buy more RAM");
+    atom_init(atom, data, n, hash);
     return atom;
 }
+static Atom* atom_table_new_atom(AtomTable* map, const char* data, size_t n, size_t hash) {
+    Atom* atom = arena_alloc_aligned(&map->arena, sizeof(*atom) + n + 1, alignof(Atom));
+    assert(atom && "Just buy more RAM");
+    atom_init(atom, data, n, hash);
+    return atom;
+}
+Atom* atom_new(const char* data, size_t n) {
+    return atom_new_hashed(data, n, atom_hash(data, n));
+}
 Atom* atom_new_cstr(const char* data) {
     return atom_new(data, strlen(data));
 }
 Atom* atom_table_get_or_insert_new(AtomTable* map, const char* data, size_t data_len) {
-    Atom* atom = atom_table_get(map, data, data_len);
+    size_t hash = atom_hash(data, data_len);
+    Atom* atom = atom_table_get_hashed(map, data, data_len, hash);
     if(!atom) {
-        atom = atom_new(data, data_len);
+        atom = atom_table_new_atom(map, data, data_len, hash);
         atom_table_insert(map, atom);
     }
     return atom;
@@ -90,3 +176,18 @@ Atom* atom_table_get_or_insert_new(AtomTable* map, const char* data, size_t data
 Atom* atom_table_get_or_insert_new_cstr(AtomTable* map, const char* data) {
     return atom_table_get_or_insert_new(map, data, strlen(data));
 }
+Atom* atom_table_intern(AtomTable* map, const Atom* other) {
+    Atom* atom = atom_table_get_hashed(map, other->data, other->len, other->hash);
+    if(!atom) {
+        atom = atom_table_new_atom(map, other->data, other->len, other->hash);
+        atom_table_insert(map, atom);
+    }
+    return atom;
+}
+void atom_table_destroy(AtomTable* map) {
+    ATOM_TABLE_DEALLOC(map->slots.items, map->slots.cap * sizeof(*map->slots.items));
+    arena_free(&map->arena);
+    map->slots.items = NULL;
+    map->slots.cap = 0;
+    map->len = 0;
+}
@@ -51,9 +51,108 @@ DEFER:
     return result;
 }
 
-void remove_carrige_return(char* content){
-    char* cur = content;
-    while ((cur = strchr(cur, '\r'))) {
-        memmove(cur, cur + 1, strlen(cur + 1) + 1);
+#ifdef _WIN32
+bool map_entire_file(const char* path, FileView* view) {
+    // TODO: CreateFileMapping. Bimbows gets the slow path for now
+    view->data = read_entire_file(path, &view->size);
+    view->mapped = false;
+    return view->data != NULL;
+}
+void unmap_file(FileView* view) {
+    FS_DEALLOC((char*)view->data, view->size+1);
+    view->data = NULL;
+    view->size = 0;
+}
+size_t read_available(FILE* f, char* buf, size_t cap) {
+    size_t n = fread(buf, 1, cap, f);
+    if(n == 0 && ferror(f)) fprintf(stderr, "ERROR Could not read: %s\n", strerror(errno));
+    return n;
+}
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+static bool read_entire_fd(const char* path, int fd, FileView* view) {
+    size_t cap = 64 * 1024, size = 0;
+    char* data = FS_MALLOC(cap);
+    assert(data && "Ran out of memory");
+    for(;;) {
+        if(size == cap) {
+            cap *= 2;
+            char* ndata = realloc(data, cap);
+            assert(ndata && "Ran out of memory");
+            data = ndata;
+        }
+        ssize_t n = read(fd, data + size, cap - size);
+        if(n == 0) break;
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            fprintf(stderr, "ERROR Could not read from %s: %s\n", path, strerror(errno));
+            FS_DEALLOC(data, cap);
+            return false;
+        }
+        size += n;
+    }
+    if(size == 0) {
+        FS_DEALLOC(data, cap);
+        data = "";
+    }
+    view->data = data;
+    view->size = size;
+    view->mapped = false;
+    return true;
+}
+bool map_entire_file(const char* path, FileView* view) {
+    if(strcmp(path, "-") == 0) return read_entire_fd("stdin", STDIN_FILENO, view);
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr, "ERROR Could not open file %s: %s\n",path,strerror(errno));
+        return false;
     }
+    bool result = true;
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+        fprintf(stderr, "ERROR Could not stat file %s: %s\n",path,strerror(errno));
+        defer_return(false);
+    }
+    if(!S_ISREG(st.st_mode)) defer_return(read_entire_fd(path, fd, view));
+    if(st.st_size == 0) {
+        // mmap doesn't like empty mappings
+        view->data = "";
+        view->size = 0;
+        view->mapped = false;
+        defer_return(true);
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+        fprintf(stderr, "ERROR Could not mmap file %s: %s\n",path,strerror(errno));
+        defer_return(false);
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+#endif
+    view->data = data;
+    view->size = st.st_size;
+    view->mapped = true;
+DEFER:
+    close(fd);
+    return result;
+}
+size_t read_available(FILE* f, char* buf, size_t cap) {
+    for(;;) {
+        ssize_t n = read(fileno(f), buf, cap);
+        if(n >= 0) return n;
+        if(errno == EINTR) continue;
+        fprintf(stderr, "ERROR Could not read: %s\n", strerror(errno));
+        return 0;
+    }
+}
+void unmap_file(FileView* view) {
+    if(view->mapped) munmap((void*)view->data, view->size);
+    else if(view->size) FS_DEALLOC((char*)view->data, view->size);
+    view->data = NULL;
+    view->size = 0;
+    view->mapped = false;
 }
+#endif
@@ -7,129 +7,552 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <atom.h>
+#include <math.h>
+#include "number.h"
 
 #define JSVM_OBJECT_ALLOC malloc
 #define JSVM_OBJECT_DEALLOC(ptr, n) free(ptr)
-#define JSVM_OBJECT_BUCKET_ALLOC malloc
 
-bool jsvm_object_reserve(JsVmObject* map, size_t extra) {
-    if(map->len + extra > map->buckets.len) {
-        size_t ncap = map->buckets.len*2 + extra;
-        JsVmObjectBucket** newbuckets = JSVM_OBJECT_ALLOC(sizeof(*newbuckets)*ncap);
-        if(!newbuckets) return false;
-        memset(newbuckets, 0, sizeof(*newbuckets) * ncap);
-        for(size_t i = 0; i < map->buckets.len; ++i) {
-            JsVmObjectBucket* oldbucket = map->buckets.items[i];
-            while(oldbucket) {
-                JsVmObjectBucket* next = oldbucket->next;
-                size_t hash = ((size_t)oldbucket->key) % ncap;
-                JsVmObjectBucket* newbucket = newbuckets[hash];
-                oldbucket->next = newbucket;
-                newbuckets[hash] = oldbucket;
-                oldbucket = next;
-            }
+#define JSVM_SHAPE_ALLOC malloc
+#define JSVM_GLOBALS_ALLOC malloc
+#define JSVM_GLOBALS_DEALLOC(ptr, n) free(ptr)
+
+// Atoms are carved out of the AtomTable's arena aligned to alignof(Atom)
+// (the well-known ones are statics), so the low bits of the pointer are always 0.
+// Mix them into the rest before using it for anything modulo a power of 2
+static inline size_t jsvm_ptr_hash(const void* ptr) {
+    uint64_t x = (uintptr_t)ptr;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+static bool jsvm_globals_reserve(JsVmGlobals* globals, size_t extra) {
+    if((globals->names.len + extra) * 2 <= globals->index.cap) return true;
+    size_t ncap = globals->index.cap ? globals->index.cap : 16;
+    while((globals->names.len + extra) * 2 > ncap) ncap *= 2;
+    uint32_t* index = JSVM_GLOBALS_ALLOC(sizeof(*index) * ncap);
+    if(!index) return false;
+    memset(index, 0, sizeof(*index) * ncap);
+    for(size_t i = 0; i < globals->names.len; ++i) {
+        size_t at = jsvm_ptr_hash(globals->names.items[i]) & (ncap-1);
+        while(index[at]) at = (at+1) & (ncap-1);
+        index[at] = i+1;
+    }
+    JSVM_GLOBALS_DEALLOC(globals->index.items, globals->index.cap * sizeof(*index));
+    globals->index.items = index;
+    globals->index.cap = ncap;
+    return true;
+}
+size_t jsvm_globals_resolve(JsVmGlobals* globals, Atom* name) {
+    bool ok = jsvm_globals_reserve(globals, 1);
+    assert(ok && "Just buy more RAM");
+    size_t mask = globals->index.cap-1;
+    size_t at = jsvm_ptr_hash(name) & mask;
+    while(globals->index.items[at]) {
+        size_t cell = globals->index.items[at]-1;
+        if(globals->names.items[cell] == name) return cell;
+        at = (at+1) & mask;
+    }
+    da_push(&globals->names, name);
+    da_push(&globals->values, jsvm_undefined());
+    globals->index.items[at] = globals->names.len;
+    return globals->names.len-1;
+}
+void jsvm_globals_define(JsVmGlobals* globals, Atom* name, JsVmValue value) {
+    size_t cell = jsvm_globals_resolve(globals, name);
+    globals->values.items[cell] = value;
+}
+
+static JsVmShape jsvm_shape_root = { 0 };
+// Shape of every object in dictionary mode. Has no keys and no transitions
+static JsVmShape jsvm_shape_dict = { 0 };
+static inline JsVmShape* jsvm_object_shape(const JsVmObject* map) {
+    return map->shape ? map->shape : &jsvm_shape_root;
+}
+static inline bool jsvm_object_is_dict(const JsVmObject* map) {
+    return map->shape == &jsvm_shape_dict;
+}
+// Returns the slot of name or -1 if the shape doesn't have it
+static ptrdiff_t jsvm_shape_lookup(const JsVmShape* shape, Atom* name) {
+    while(shape->len) {
+        if(shape->key == name) return shape->len-1;
+        shape = shape->parent;
+    }
+    return -1;
+}
+static JsVmShape* jsvm_shape_transition(JsVmShape* shape, Atom* name) {
+    for(size_t i = 0; i < shape->transitions.len; ++i) {
+        if(shape->transitions.items[i]->key == name) return shape->transitions.items[i];
+    }
+    JsVmShape* child = JSVM_SHAPE_ALLOC(sizeof(*child));
+    if(!child) return NULL;
+    memset(child, 0, sizeof(*child));
+    child->parent = shape;
+    child->key = name;
+    child->len = shape->len + 1;
+    da_push(&shape->transitions, child);
+    return child;
+}
+
+static inline size_t jsvm_object_dict_dist(const JsVmObjectEntry* entry, size_t at, size_t mask) {
+    return (at - (jsvm_ptr_hash(entry->key) & mask)) & mask;
+}
+static void jsvm_object_dict_place(JsVmObjectEntry* entries, size_t mask, JsVmObjectEntry entry) {
+    size_t at = jsvm_ptr_hash(entry.key) & mask;
+    size_t dist = 0;
+    while(entries[at].key) {
+        size_t other = jsvm_object_dict_dist(&entries[at], at, mask);
+        // Rob from the rich and give to the poor
+        if(other < dist) {
+            JsVmObjectEntry tmp = entries[at];
+            entries[at] = entry;
+            entry = tmp;
+            dist = other;
         }
-        JSVM_OBJECT_DEALLOC(map->buckets.items, map->buckets.cap * sizeof(*map->buckets.items));
-        map->buckets.items = newbuckets;
-        map->buckets.len = ncap;
+        at = (at+1) & mask;
+        dist++;
+    }
+    entries[at] = entry;
+}
+// Shaped objects keep their properties in slots, only dictionaries have entries
+static bool jsvm_object_dict_reserve(JsVmObject* map, size_t extra) {
+    assert(jsvm_object_is_dict(map));
+    // Keep the load factor under 3/4
+    if((map->len + extra) * 4 > map->entries.cap * 3) {
+        size_t ncap = map->entries.cap ? map->entries.cap : 8;
+        while((map->len + extra) * 4 > ncap * 3) ncap *= 2;
+        JsVmObjectEntry* entries = JSVM_OBJECT_ALLOC(sizeof(*entries)*ncap);
+        if(!entries) return false;
+        memset(entries, 0, sizeof(*entries) * ncap);
+        for(size_t i = 0; i < map->entries.cap; ++i) {
+            if(map->entries.items[i].key) jsvm_object_dict_place(entries, ncap-1, map->entries.items[i]);
+        }
+        JSVM_OBJECT_DEALLOC(map->entries.items, map->entries.cap * sizeof(*map->entries.items));
+        map->entries.items = entries;
+        map->entries.cap = ncap;
     }
     return true;
 }
-bool jsvm_object_insert(JsVmObject* map, Atom* name, JsVmValue value) {
-    if(!jsvm_object_reserve(map, 1)) return false;
-    size_t hash = ((size_t)name) % map->buckets.len;
-    JsVmObjectBucket* into = map->buckets.items[hash];
-    JsVmObjectBucket* bucket = JSVM_OBJECT_BUCKET_ALLOC(sizeof(JsVmObjectBucket));
-    if(!bucket) return false;
-    bucket->next = into;
-    bucket->key = name;
-    bucket->value = value;
-    map->buckets.items[hash] = bucket;
+// NOTE: does NOT check for duplicates.
+static bool jsvm_object_dict_insert(JsVmObject* map, Atom* name, JsVmValue value) {
+    if(!jsvm_object_dict_reserve(map, 1)) return false;
+    jsvm_object_dict_place(map->entries.items, map->entries.cap-1, (JsVmObjectEntry) { name, value });
     map->len++;
     return true;
 }
-static JsVmObjectBucket* jsvm_object_get(JsVmObject* map, Atom* name) {
+static JsVmObjectEntry* jsvm_object_dict_get(JsVmObject* map, Atom* name) {
     if(map->len == 0) return NULL;
-    assert(map->buckets.len > 0);
-    size_t hash = ((size_t)name) % map->buckets.len;
-    JsVmObjectBucket* bucket = map->buckets.items[hash];
-    while(bucket) {
-        if(bucket->key == name) return bucket;
-        bucket = bucket->next;
+    size_t mask = map->entries.cap-1;
+    size_t at = jsvm_ptr_hash(name) & mask;
+    for(size_t dist = 0; map->entries.items[at].key; ++dist) {
+        JsVmObjectEntry* entry = &map->entries.items[at];
+        if(entry->key == name) return entry;
+        // Would've robbed this entry's spot if it were here
+        if(jsvm_object_dict_dist(entry, at, mask) < dist) break;
+        at = (at+1) & mask;
     }
     return NULL;
 }
-static inline JsVmValue jsvm_undefined(void) {
-    return (JsVmValue) {
-        .kind = JSVM_VALUE_UNDEFINED
-    };
+static bool jsvm_object_to_dict(JsVmObject* map) {
+    JsVmShape* shape = jsvm_object_shape(map);
+    JsVmValue* slots = map->slots.items;
+    map->shape = &jsvm_shape_dict;
+    map->slots.items = NULL;
+    map->slots.len = map->slots.cap = 0;
+    map->len = 0;
+    if(!jsvm_object_dict_reserve(map, shape->len)) return false;
+    for(; shape->len; shape = shape->parent) {
+        if(!jsvm_object_dict_insert(map, shape->key, slots[shape->len-1])) return false;
+    }
+    JSVM_OBJECT_DEALLOC(slots, 0);
+    return true;
+}
+static JsVmValue* jsvm_object_get(JsVmObject* map, Atom* name) {
+    if(jsvm_object_is_dict(map)) {
+        JsVmObjectEntry* entry = jsvm_object_dict_get(map, name);
+        return entry ? &entry->value : NULL;
+    }
+    ptrdiff_t slot = jsvm_shape_lookup(jsvm_object_shape(map), name);
+    return slot < 0 ? NULL : &map->slots.items[slot];
+}
+bool jsvm_object_insert(JsVmObject* map, Atom* name, JsVmValue value) {
+    JsVmValue* existing = jsvm_object_get(map, name);
+    if(existing) {
+        *existing = value;
+        return true;
+    }
+    if(!jsvm_object_is_dict(map) && jsvm_object_shape(map)->len >= JSVM_SHAPE_MAX_PROPS) {
+        if(!jsvm_object_to_dict(map)) return false;
+    }
+    if(jsvm_object_is_dict(map)) return jsvm_object_dict_insert(map, name, value);
+    JsVmShape* shape = jsvm_shape_transition(jsvm_object_shape(map), name);
+    if(!shape) return false;
+    da_push(&map->slots, value);
+    map->shape = shape;
+    map->len++;
+    return true;
+}
+static JsVmValue* jsvm_object_get_cached(JsVmObject* map, JsVmMemberSite* site) {
+    if(!site->megamorphic) {
+        for(size_t i = 0; i < site->len; ++i) {
+            if(site->shapes[i] == map->shape) return &map->slots.items[site->slots[i]];
+        }
+        if(!jsvm_object_is_dict(map)) {
+            ptrdiff_t slot = jsvm_shape_lookup(jsvm_object_shape(map), site->atom);
+            if(slot < 0) return NULL;
+            if(site->len == JSVM_IC_POLY) site->megamorphic = true;
+            else {
+                site->shapes[site->len] = map->shape;
+                site->slots[site->len] = slot;
+                site->len++;
+            }
+            return &map->slots.items[slot];
+        }
+    }
+    return jsvm_object_get(map, site->atom);
+}
+static void jsvm_dump_shape(FILE* sink, const JsVmShape* shape, const JsVmValue* slots) {
+    if(!shape->len) return;
+    jsvm_dump_shape(sink, shape->parent, slots);
+    if(shape->len > 1) fprintf(sink, ", ");
+    fprintf(sink, "%s: ", shape->key->data);
+    jsvm_dump_value(sink, &slots[shape->len-1]);
+}
+JsVmString* jsvm_string_new(const char* data, size_t len) {
+    JsVmString* string = malloc(sizeof(*string) + len);
+    assert(string && "Just buy more RAM");
+    string->len = len;
+    memcpy(string->data, data, len);
+    return string;
 }
 void jsvm_dump_value(FILE* sink, const JsVmValue* value) {
-    static_assert(JSVM_VALUE_COUNT == 4, "Update jsvm_dump_value");
-    switch(value->kind) {
+    static_assert(JSVM_VALUE_COUNT == 8, "Update jsvm_dump_value");
+    switch(jsvm_value_kind(*value)) {
     case JSVM_VALUE_UNDEFINED:
         fprintf(sink, "undefined");
         break;
+    case JSVM_VALUE_NULL:
+        fprintf(sink, "null");
+        break;
+    case JSVM_VALUE_BOOL:
+        fprintf(sink, jsvm_value_as_bool(*value) ? "true" : "false");
+        break;
+    case JSVM_VALUE_INT:
+        fprintf(sink, "%d", jsvm_value_as_int(*value));
+        break;
+    case JSVM_VALUE_NUMBER: {
+        char buf[NUMBER_FORMAT_MAX];
+        number_format(jsvm_value_as_number(*value), buf);
+        fprintf(sink, "%s", buf);
+    } break;
     case JSVM_VALUE_FUNC:
-        fprintf(sink, "<Function: #%08llx>", (unsigned long long)value->as.func.func);
+        fprintf(sink, "<Function: #%08llx>", (unsigned long long)jsvm_value_as_func(*value));
         break;
     case JSVM_VALUE_OBJECT: {
-        JsVmObject* object = value->as.object;
+        JsVmObject* object = jsvm_value_as_object(*value);
         size_t n = 0;
         fprintf(sink, "{");
-        for(size_t i = 0; i < object->buckets.len; ++i) {
-            JsVmObjectBucket* bucket = object->buckets.items[i];
-            while(bucket) {
-                if(n > 0) fprintf(sink, ", ");
-                fprintf(sink, "%s: ", bucket->key->data);
-                jsvm_dump_value(sink, &bucket->value);
-                n++;
-                bucket = bucket->next;
-            }
+        if(!jsvm_object_is_dict(object)) jsvm_dump_shape(sink, jsvm_object_shape(object), object->slots.items);
+        else for(size_t i = 0; i < object->entries.cap; ++i) {
+            JsVmObjectEntry* entry = &object->entries.items[i];
+            if(!entry->key) continue;
+            if(n > 0) fprintf(sink, ", ");
+            fprintf(sink, "%s: ", entry->key->data);
+            jsvm_dump_value(sink, &entry->value);
+            n++;
         }
         fprintf(sink, "}");
     } break;
-    case JSVM_VALUE_STRING:
+    case JSVM_VALUE_STRING: {
+        JsVmString* string = jsvm_value_as_string(*value);
         fprintf(sink, "\"");
-        for(size_t i = 0; i < value->as.string.len; ++i) {
-            char c = value->as.string.items[i];
+        for(size_t i = 0; i < string->len; ++i) {
+            char c = string->data[i];
             if(isgraph(c)) fprintf(sink, "%c", c);
             else fprintf(sink, "\\x%02X", c);
         }
         fprintf(sink, "\"");
-        break;
+    } break;
     }
 }
-void jsvm_interpret(JsVmObject* globals, JsVmStack* stack, JsVmInstruction* inst) {
-    (void)stack;
-    (void)inst;
-    static_assert(JSVM_INST_COUNT == 6, "Update jsvm_interpret");
-    switch(inst->kind) {
-    case JSVM_PUSH_STR: {
-        JsVmValue value = {
-            .kind = JSVM_VALUE_STRING,
-            .as.string = { 0 }
-        };
-        da_reserve(&value.as.string, inst->as.push_str.len);
-        memcpy(value.as.string.items, inst->as.push_str.data, inst->as.push_str.len);
-        value.as.string.len += inst->as.push_str.len;
-        da_push(stack, value);
-    } break;
-    case JSVM_GET_GLOBAL: {
-        JsVmObjectBucket* bucket = jsvm_object_get(globals, inst->as.atom);
+void jsvm_emit_op(JsVmUnit* unit, uint8_t op) {
+    da_push(&unit->code, op);
+}
+void jsvm_emit_uint(JsVmUnit* unit, size_t n) {
+    while(n >= 0x80) {
+        da_push(&unit->code, (uint8_t)(n | 0x80));
+        n >>= 7;
+    }
+    da_push(&unit->code, (uint8_t)n);
+}
+size_t jsvm_unit_add_member(JsVmUnit* unit, Atom* atom) {
+    da_push(&unit->members, ((JsVmMemberSite) { .atom = atom }));
+    return unit->members.len-1;
+}
+size_t jsvm_unit_add_str(JsVmUnit* unit, const char* data, size_t len) {
+    da_push(&unit->consts, jsvm_value_string(jsvm_string_new(data, len)));
+    return unit->consts.len-1;
+}
+size_t jsvm_unit_add_number(JsVmUnit* unit, double number) {
+    da_push(&unit->consts, jsvm_value_number(number));
+    return unit->consts.len-1;
+}
+void jsvm_emit_number(JsVmUnit* unit, double number) {
+    // -0 has to stay a double
+    if(number >= INT32_MIN && number <= INT32_MAX && number == (int32_t)number && !(number == 0 && signbit(number))) {
+        int32_t i = (int32_t)number;
+        jsvm_emit_op(unit, JSVM_PUSH_INT);
+        jsvm_emit_uint(unit, ((uint32_t)i << 1) ^ (uint32_t)(i >> 31));
+        return;
+    }
+    jsvm_emit_op(unit, JSVM_PUSH_NUM);
+    jsvm_emit_uint(unit, jsvm_unit_add_number(unit, number));
+}
+// Points at value converted to a string (for '+'). Numbers get formatted into buf
+static const char* jsvm_value_to_str(JsVmValue value, char buf[NUMBER_FORMAT_MAX], size_t* len) {
+    static_assert(JSVM_VALUE_COUNT == 8, "Update jsvm_value_to_str");
+    static const char undefined[] = "undefined", object[] = "[object Object]", func[] = "function () { [native code] }";
+    switch(jsvm_value_kind(value)) {
+    case JSVM_VALUE_NULL:
+        *len = 4;
+        return "null";
+    case JSVM_VALUE_BOOL:
+        *len = jsvm_value_as_bool(value) ? 4 : 5;
+        return jsvm_value_as_bool(value) ? "true" : "false";
+    case JSVM_VALUE_STRING:
+        *len = jsvm_value_as_string(value)->len;
+        return jsvm_value_as_string(value)->data;
+    case JSVM_VALUE_INT:
+        *len = snprintf(buf, NUMBER_FORMAT_MAX, "%d", jsvm_value_as_int(value));
+        return buf;
+    case JSVM_VALUE_NUMBER:
+        *len = number_format(jsvm_value_as_number(value), buf);
+        return buf;
+    case JSVM_VALUE_OBJECT:
+        *len = sizeof(object)-1;
+        return object;
+    case JSVM_VALUE_FUNC:
+        *len = sizeof(func)-1;
+        return func;
+    default:
+        *len = sizeof(undefined)-1;
+        return undefined;
+    }
+}
+// Bytes of the (UTF-8) JS whitespace or line terminator at p, 0 if there isn't one
+static size_t jsvm_space_len(const char* p, const char* end) {
+    const uint8_t* u = (const uint8_t*)p;
+    size_t n = end - p;
+    if(u[0] == ' ' || (u[0] >= '\t' && u[0] <= '\r')) return 1;
+    // U+00A0
+    if(n >= 2 && u[0] == 0xC2 && u[1] == 0xA0) return 2;
+    if(n < 3) return 0;
+    // U+1680
+    if(u[0] == 0xE1 && u[1] == 0x9A && u[2] == 0x80) return 3;
+    // U+2000-U+200A, U+2028, U+2029, U+202F
+    if(u[0] == 0xE2 && u[1] == 0x80 && (u[2] <= 0x8A || u[2] == 0xA8 || u[2] == 0xA9 || u[2] == 0xAF)) return 3;
+    // U+205F
+    if(u[0] == 0xE2 && u[1] == 0x81 && u[2] == 0x9F) return 3;
+    // U+3000
+    if(u[0] == 0xE3 && u[1] == 0x80 && u[2] == 0x80) return 3;
+    // U+FEFF
+    if(u[0] == 0xEF && u[1] == 0xBB && u[2] == 0xBF) return 3;
+    return 0;
+}
+// 0x, 0o and 0b integers. No sign allowed
+static double jsvm_parse_radix(const char* p, const char* end, unsigned radix) {
+    if(p == end) return NAN;
+    double number = 0;
+    for(; p < end; ++p) {
+        unsigned c = (uint8_t)*p, digit;
+        if(c >= '0' && c <= '9') digit = c - '0';
+        else if((c | 0x20) >= 'a' && (c | 0x20) <= 'f') digit = (c | 0x20) - 'a' + 10;
+        else return NAN;
+        if(digit >= radix) return NAN;
+        number = number * radix + digit;
+    }
+    return number;
+}
+// StringToNumber: surrounding whitespace, an optional sign then a decimal literal
+// or Infinity, or an unsigned 0x/0o/0b integer. Empty (or all whitespace) is 0
+static double jsvm_string_to_number(const JsVmString* string) {
+    const char* p = string->data, *end = p + string->len;
+    size_t n;
+    while(p < end && (n = jsvm_space_len(p, end))) p += n;
+    // Walks forward since UTF-8 whitespace can't be recognized backwards
+    const char* last = p;
+    for(const char* q = p; q < end;) {
+        if((n = jsvm_space_len(q, end))) q += n;
+        else last = ++q;
+    }
+    end = last;
+    if(p == end) return 0;
+    if(end - p > 2 && p[0] == '0') {
+        switch(p[1] | 0x20) {
+        case 'x': return jsvm_parse_radix(p + 2, end, 16);
+        case 'o': return jsvm_parse_radix(p + 2, end, 8);
+        case 'b': return jsvm_parse_radix(p + 2, end, 2);
+        }
+    }
+    bool neg = false;
+    if(*p == '+' || *p == '-') neg = *p++ == '-';
+    double number;
+    static const char infinity[] = "Infinity";
+    if((size_t)(end - p) == sizeof(infinity)-1 && memcmp(p, infinity, sizeof(infinity)-1) == 0) number = INFINITY;
+    else if(!number_parse(p, end, &number)) return NAN;
+    return neg ? -number : number;
+}
+static double jsvm_value_to_number(JsVmValue value) {
+    switch(jsvm_value_kind(value)) {
+    case JSVM_VALUE_INT:
+        return jsvm_value_as_int(value);
+    case JSVM_VALUE_NUMBER:
+        return jsvm_value_as_number(value);
+    case JSVM_VALUE_STRING:
+        return jsvm_string_to_number(jsvm_value_as_string(value));
+    case JSVM_VALUE_NULL:
+        return 0;
+    case JSVM_VALUE_BOOL:
+        return jsvm_value_as_bool(value);
+    // Objects and functions turn into strings that aren't numbers
+    default:
+        return NAN;
+    }
+}
+// Results that fit in an int32 stay ints.
+// -0 doesn't exist as an int, so anything that could produce it goes through double
+static inline JsVmValue jsvm_int_result(int64_t n) {
+    return n == (int32_t)n ? jsvm_value_int((int32_t)n) : jsvm_value_number((double)n);
+}
+static inline JsVmValue jsvm_int_add(int32_t a, int32_t b) {
+    return jsvm_int_result((int64_t)a + b);
+}
+static inline JsVmValue jsvm_int_sub(int32_t a, int32_t b) {
+    return jsvm_int_result((int64_t)a - b);
+}
+static inline JsVmValue jsvm_int_mul(int32_t a, int32_t b) {
+    int64_t n = (int64_t)a * b;
+    if(n == 0 && (a < 0 || b < 0)) return jsvm_value_number(-0.0);
+    return jsvm_int_result(n);
+}
+static inline JsVmValue jsvm_int_div(int32_t a, int32_t b) {
+    if(b != 0 && (int64_t)a % b == 0 && !(a == 0 && b < 0)) return jsvm_int_result((int64_t)a / b);
+    return jsvm_value_number((double)a / b);
+}
+static JsVmValue jsvm_add(JsVmValue lhs, JsVmValue rhs) {
+    uint8_t lkind = jsvm_value_kind(lhs), rkind = jsvm_value_kind(rhs);
+    // Strings win over numbers. Objects and functions get turned into strings first
+    if(lkind == JSVM_VALUE_STRING || lkind == JSVM_VALUE_OBJECT || lkind == JSVM_VALUE_FUNC ||
+       rkind == JSVM_VALUE_STRING || rkind == JSVM_VALUE_OBJECT || rkind == JSVM_VALUE_FUNC) {
+        char lbuf[NUMBER_FORMAT_MAX], rbuf[NUMBER_FORMAT_MAX];
+        size_t llen, rlen;
+        const char* l = jsvm_value_to_str(lhs, lbuf, &llen);
+        const char* r = jsvm_value_to_str(rhs, rbuf, &rlen);
+        JsVmString* string = malloc(sizeof(*string) + llen + rlen);
+        assert(string && "Just buy more RAM");
+        string->len = llen + rlen;
+        memcpy(string->data, l, llen);
+        memcpy(string->data + llen, r, rlen);
+        return jsvm_value_string(string);
+    }
+    return jsvm_value_number(jsvm_value_to_number(lhs) + jsvm_value_to_number(rhs));
+}
+static JsVmValue jsvm_sub(JsVmValue lhs, JsVmValue rhs) {
+    return jsvm_value_number(jsvm_value_to_number(lhs) - jsvm_value_to_number(rhs));
+}
+static JsVmValue jsvm_mul(JsVmValue lhs, JsVmValue rhs) {
+    return jsvm_value_number(jsvm_value_to_number(lhs) * jsvm_value_to_number(rhs));
+}
+static JsVmValue jsvm_div(JsVmValue lhs, JsVmValue rhs) {
+    return jsvm_value_number(jsvm_value_to_number(lhs) / jsvm_value_to_number(rhs));
+}
+static inline size_t jsvm_read_uint(const uint8_t** ip) {
+    const uint8_t* p = *ip;
+    size_t n = *p++;
+    if(n >= 0x80) {
+        n &= 0x7F;
+        size_t shift = 7;
+        uint8_t b;
+        do {
+            b = *p++;
+            n |= (size_t)(b & 0x7F) << shift;
+            shift += 7;
+        } while(b & 0x80);
+    }
+    *ip = p;
+    return n;
+}
+// NOTE: computed goto is a GNU extension. Everyone else gets the switch.
+#if !defined(JSVM_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#   define JSVM_COMPUTED_GOTO 1
+#endif
+// Pops rhs and replaces lhs with the result. Two ints take the int path
+#define JSVM_ARITH(int_op, op) \
+    do {\
+        assert(stack->len > 1);\
+        JsVmValue rhs = da_pop(stack);\
+        JsVmValue* lhs = &stack->items[stack->len-1];\
+        if(jsvm_value_kind(*lhs) == JSVM_VALUE_INT && jsvm_value_kind(rhs) == JSVM_VALUE_INT)\
+            *lhs = int_op(jsvm_value_as_int(*lhs), jsvm_value_as_int(rhs));\
+        else *lhs = op(*lhs, rhs);\
+    } while(0)
+#if JSVM_COMPUTED_GOTO
+#   define JSVM_CASE(op) LABEL_##op
+#   define JSVM_DISPATCH() \
+    do {\
+        if(ip == end) return;\
+        goto *dispatch[*ip++];\
+    } while(0)
+#else
+#   define JSVM_CASE(op) case op
+#   define JSVM_DISPATCH() continue
+#endif
+void jsvm_run(JsVmGlobals* globals, JsVmStack* stack, JsVmUnit* unit) {
+    static_assert(JSVM_INST_COUNT == 14, "Update jsvm_run");
+    const uint8_t* ip = unit->code.items;
+    const uint8_t* end = ip + unit->code.len;
+#if JSVM_COMPUTED_GOTO
+    static const void* dispatch[JSVM_INST_COUNT] = {
+        [JSVM_GET_GLOBAL] = &&LABEL_JSVM_GET_GLOBAL,
+        [JSVM_GET_MEMBER] = &&LABEL_JSVM_GET_MEMBER,
+        [JSVM_PUSH_STR]   = &&LABEL_JSVM_PUSH_STR,
+        [JSVM_CALL]       = &&LABEL_JSVM_CALL,
+        [JSVM_DUP]        = &&LABEL_JSVM_DUP,
+        [JSVM_THIS]       = &&LABEL_JSVM_THIS,
+        [JSVM_PUSH_NUM]   = &&LABEL_JSVM_PUSH_NUM,
+        [JSVM_PUSH_INT]   = &&LABEL_JSVM_PUSH_INT,
+        [JSVM_ADD]        = &&LABEL_JSVM_ADD,
+        [JSVM_SUB]        = &&LABEL_JSVM_SUB,
+        [JSVM_MUL]        = &&LABEL_JSVM_MUL,
+        [JSVM_DIV]        = &&LABEL_JSVM_DIV,
+        [JSVM_PUSH_BOOL]  = &&LABEL_JSVM_PUSH_BOOL,
+        [JSVM_PUSH_NULL]  = &&LABEL_JSVM_PUSH_NULL,
+    };
+    JSVM_DISPATCH();
+#else
+    while(ip < end)
+    switch(*ip++)
+#endif
+    {
+    JSVM_CASE(JSVM_PUSH_STR): {
+        da_push(stack, unit->consts.items[jsvm_read_uint(&ip)]);
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_GET_GLOBAL): {
         // TODO: technically incorrect. We'd need jsvm_value_clone
-        da_push(stack, bucket ? bucket->value : jsvm_undefined());
-    } break;
-    case JSVM_GET_MEMBER: {
+        da_push(stack, globals->values.items[jsvm_read_uint(&ip)]);
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_GET_MEMBER): {
+        JsVmMemberSite* site = &unit->members.items[jsvm_read_uint(&ip)];
         assert(stack->len > 0);
         JsVmValue value = da_pop(stack);
-        switch(value.kind) {
+        switch(jsvm_value_kind(value)) {
         case JSVM_VALUE_OBJECT: {
-            JsVmObjectBucket* bucket = jsvm_object_get(value.as.object, inst->as.atom);
+            JsVmValue* member = jsvm_object_get_cached(jsvm_value_as_object(value), site);
             // TODO: technically incorrect. We'd need jsvm_value_clone
-            da_push(stack, bucket ? bucket->value : jsvm_undefined());
-            if(!bucket) {
-                fprintf(stderr, "ERROR Failed to get member: %s of ", inst->as.atom->data);
+            da_push(stack, member ? *member : jsvm_undefined());
+            if(!member) {
+                fprintf(stderr, "ERROR Failed to get member: %s of ", site->atom->data);
                 jsvm_dump_value(stderr, &value);
                 fprintf(stderr, "\n");
             }
@@ -140,14 +563,16 @@ void jsvm_interpret(JsVmObject* globals, JsVmStack* stack, JsVmInstruction* inst
             fprintf(stderr, "\n");
             abort();
         }
-    } break;
-    case JSVM_CALL: {
-        assert(stack->len > 0);
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_CALL): {
+        size_t num_args = jsvm_read_uint(&ip);
+        // The callee and this
+        assert(stack->len >= 2);
         JsVmValue value = da_pop(stack);
         JsVmValue this = da_pop(stack);
-        switch(value.kind) {
+        switch(jsvm_value_kind(value)) {
         case JSVM_VALUE_FUNC: {
-            value.as.func.func(&this, &value, stack, inst->as.call.num_args);
+            jsvm_value_as_func(value)(&this, &value, stack, num_args);
         } break;
         default:
             fprintf(stderr, "TODO "__FILE__":"STRINGIFY1(__LINE__)": throw runtime error on calling non function: ");
@@ -155,19 +580,46 @@ void jsvm_interpret(JsVmObject* globals, JsVmStack* stack, JsVmInstruction* inst
             fprintf(stderr, "\n");
             abort();
         }
-    } break;
-    case JSVM_DUP: {
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_DUP): {
         assert(stack->len > 0);
         da_reserve(stack, 1);
         JsVmValue value = stack->items[stack->len-1];
         // TODO: technically incorrect. We'd need jsvm_value_clone
         da_push(stack, value);
-    } break;
-    case JSVM_THIS: {
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_THIS): {
         // TODO: this
         da_push(stack, jsvm_undefined());
-    } break;
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_PUSH_NUM): {
+        da_push(stack, unit->consts.items[jsvm_read_uint(&ip)]);
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_PUSH_INT): {
+        uint32_t n = (uint32_t)jsvm_read_uint(&ip);
+        da_push(stack, jsvm_value_int((int32_t)((n >> 1) ^ -(n & 1))));
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_ADD): {
+        JSVM_ARITH(jsvm_int_add, jsvm_add);
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_SUB): {
+        JSVM_ARITH(jsvm_int_sub, jsvm_sub);
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_MUL): {
+        JSVM_ARITH(jsvm_int_mul, jsvm_mul);
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_DIV): {
+        JSVM_ARITH(jsvm_int_div, jsvm_div);
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_PUSH_BOOL): {
+        da_push(stack, jsvm_value_bool(jsvm_read_uint(&ip)));
+    } JSVM_DISPATCH();
+    JSVM_CASE(JSVM_PUSH_NULL): {
+        da_push(stack, jsvm_null());
+    } JSVM_DISPATCH();
+#if !JSVM_COMPUTED_GOTO
     default:
-        todof("jsvm_interpret(%d)\n", inst->kind);
+        todof("jsvm_run(%d)\n", ip[-1]);
+#endif
     }
 }
@@ -1,9 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include <assert.h>
 #include "arena.h"
-#include "scratch.h"
+#include "scan.h"
 #include <darray.h>
 
 #include "fileutils.h"
@@ -11,115 +12,388 @@
 #include "utf8.h"
 #include "todo.h"
 #include "jsvm.h"
+#include "number.h"
+#include "js_atoms.h"
 
-typedef struct {
-    const char *path;
-    const char *cursor, *end;
-    size_t l, c;
-    AtomTable* atom_table;
-    size_t str_buffer_head, str_buffer_cap;
-    char* str_buffer;
-} JsLexer;
 enum {
     JSERR_INVALID_STRING=1,
     JSERR_INVALID_CHAR_IN_STRING,
     JSERR_EOF,
+    JSERR_INVALID_NUMBER,
+    JSERR_INVALID_UTF8,
     JSERR_COUNT
 };
+// Single character tokens are just their (ASCII) character
 enum {
-    JSTOKEN_ATOM=256,
+    JSTOKEN_ATOM=128,
     JSTOKEN_STR,
+    JSTOKEN_NUMBER,
+    // Keywords carry their atom just like JSTOKEN_ATOM
+#define X(NAME, name) JSTOKEN_##NAME,
+    JS_KEYWORDS
+#undef X
     JSTOKEN_COUNT
 };
+#define JSTOKEN_KEYWORD_FIRST (JSTOKEN_NUMBER+1)
+static inline bool js_token_is_keyword(int kind) {
+    return kind >= JSTOKEN_KEYWORD_FIRST && kind < JSTOKEN_COUNT;
+}
+// Well-known atoms (see nob.c) are compile time constants.
+// js_atoms_init fills in their hashes and puts them in the AtomTable
+#define X(NAME, name) static Atom js_atom_##name = { 0, sizeof(#name)-1, #name };
+JS_KEYWORDS
+JS_BUILTIN_ATOMS
+#undef X
+// NOTE: true/false/NULL are macros, use &js_atom_##name inside X lists
+#define JS_ATOM(name) (&js_atom_##name)
+static Atom* const js_keyword_atoms[JS_KEYWORD_COUNT] = {
+#define X(NAME, name) &js_atom_##name,
+    JS_KEYWORDS
+#undef X
+};
+static void js_atoms_init(AtomTable* atom_table) {
+#define X(NAME, name) \
+    js_atom_##name.hash = atom_hash(js_atom_##name.data, js_atom_##name.len); \
+    atom_table_insert(atom_table, &js_atom_##name);
+    JS_KEYWORDS
+    JS_BUILTIN_ATOMS
+#undef X
+}
+// Index into JS_KEYWORDS, or -1 if data isn't a keyword.
+// The hash is perfect for the keywords, so that's a single compare
+static int js_keyword_lookup(const char* data, size_t len) {
+    if(len < JS_KEYWORD_MIN_LEN || len > JS_KEYWORD_MAX_LEN) return -1;
+    size_t h = ((uint8_t)data[0]*JS_KEYWORD_HASH_A + (uint8_t)data[len-1]*JS_KEYWORD_HASH_B + len) & (JS_KEYWORD_SLOTS-1);
+    int i = js_keyword_slots[h] - 1;
+    if(i < 0 || js_keyword_atoms[i]->len != len || memcmp(js_keyword_atoms[i]->data, data, len) != 0) return -1;
+    return i;
+}
+typedef union {
+    Atom* atom;
+    struct {
+        const char* data;
+        size_t len;
+    } str;
+    double number;
+} JsTokenValue;
 typedef struct {
-    const char* path;
-    size_t l0, c0;
-    size_t l1, c1;
     int kind;
-    union {
-        Atom* atom;
-        struct {
-            const char* data;
-            size_t len;
-        } str;
-    } as;
+    // Bytes from the start of the input. See js_lexer_loc for line:col
+    uint32_t offset, len;
+    JsTokenValue as;
 } JsToken;
-static uint32_t js_lexer_peak_char_n(JsLexer* lexer, size_t n) {
-    const char* strm = lexer->cursor;
-    uint32_t c;
-    do {
-        c = utf8_next(&strm, lexer->end);
-    } while(n--);
-    return c;
+static_assert(JSTOKEN_COUNT <= 256, "Token kinds have to fit in JsTokenStream.kinds");
+// Keywords don't count, their atom follows from the kind
+static inline bool js_token_has_value(int kind) {
+    return kind == JSTOKEN_ATOM || kind == JSTOKEN_STR || kind == JSTOKEN_NUMBER;
 }
-static uint32_t js_lexer_peak_char(JsLexer* lexer) {
-    return js_lexer_peak_char_n(lexer, 0);
+// The whole input lexed up front (--pretokenize), one array per field.
+// Only tokens with js_token_has_value get an entry in values
+typedef struct {
+    struct {
+        uint8_t* items;
+        size_t len, cap;
+    } kinds;
+    struct {
+        uint32_t* items;
+        size_t len, cap;
+    } offsets, lens, value_index;
+    struct {
+        JsTokenValue* items;
+        size_t len, cap;
+    } values;
+    // EOF or the error lexing stopped at
+    JsToken last;
+} JsTokenStream;
+// Pulls up to cap bytes of input into buf. Returns 0 once there's nothing left
+typedef size_t (*JsLexerRead)(void* ctx, char* buf, size_t cap);
+#define JS_LEXER_CHUNK (64*1024)
+// Must be a power of 2
+#define JS_LEXER_LOOKAHEAD 4
+typedef struct {
+    const char *path;
+    // Window of the input the lexer can see.
+    // Unless streaming this is the whole source
+    const char *src;
+    const char *cursor, *end;
+    // Offset of src from the start of the input
+    size_t base;
+    // Offsets where each line starts, indexed lazily up to lines_upto.
+    // Streaming indexes whatever is about to be thrown away on refill
+    struct {
+        uint32_t* items;
+        size_t len, cap;
+    } lines;
+    size_t lines_upto;
+    bool lines_cr;
+    AtomTable* atom_table;
+    // Decoded string literals. See js_lexer_release_strs
+    Arena strs;
+    // Streaming mode
+    JsLexerRead read;
+    void* read_ctx;
+    char* buf;
+    size_t buf_cap;
+    bool read_eof;
+    // Start of the current token. Refilling never throws away anything past it
+    const char *tok;
+    // Tokens already lexed by js_lexer_peak but not consumed yet
+    JsToken ahead[JS_LEXER_LOOKAHEAD];
+    size_t ahead_head, ahead_len;
+    // Set by js_lexer_pretokenize, tokens come from here instead
+    JsTokenStream* stream;
+    size_t stream_pos;
+} JsLexer;
+// \r\n, \n and a lone \r all end a line
+static void js_lexer_index_lines(JsLexer* lexer, size_t upto) {
+    if(upto <= lexer->lines_upto) return;
+    const char* p = lexer->src + (lexer->lines_upto - lexer->base);
+    const char* end = lexer->src + (upto - lexer->base);
+    const char* nl;
+    while((nl = scan_skip_line(p, end)) < end) {
+        if(nl != p) lexer->lines_cr = false;
+        // The \n of a \r\n just moves the line start the \r put in
+        if(*nl == '\n' && lexer->lines_cr) lexer->lines.items[lexer->lines.len-1]++;
+        else da_push(&lexer->lines, (uint32_t)(lexer->base + (nl - lexer->src) + 1));
+        lexer->lines_cr = *nl == '\r';
+        p = nl + 1;
+    }
+    if(p != end) lexer->lines_cr = false;
+    lexer->lines_upto = upto;
 }
-static uint32_t js_lexer_next_char(JsLexer* lexer) {
-    uint32_t res = utf8_next(&lexer->cursor, lexer->end);
-    lexer->c++;
-    if (res == '\n') {
-        lexer->l++;
-        lexer->c = 0;
+// Maps an offset from a token back to a 1-based line and column
+static void js_lexer_loc(JsLexer* lexer, uint32_t offset, size_t* line, size_t* col) {
+    js_lexer_index_lines(lexer, offset);
+    size_t lo = 0, hi = lexer->lines.len;
+    while(hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(lexer->lines.items[mid] <= offset) lo = mid;
+        else hi = mid;
     }
-    return res;
+    *line = lo + 1;
+    *col = offset - lexer->lines.items[lo] + 1;
+}
+// Prefixes diagnostics with path:line:col
+static void js_lexer_print_loc(FILE* sink, JsLexer* lexer, uint32_t offset) {
+    size_t line, col;
+    js_lexer_loc(lexer, offset, &line, &col);
+    fprintf(sink, "%s:%zu:%zu: ", lexer->path, line, col);
+}
+// Shifts out everything the lexer is done with and reads another chunk in.
+// Returns false if there's nothing more to read
+static bool js_lexer_refill(JsLexer* lexer) {
+    if(!lexer->read || lexer->read_eof) return false;
+    const char* keep = lexer->tok;
+    if(!keep || keep > lexer->cursor) keep = lexer->cursor;
+    size_t drop = keep - lexer->src;
+    size_t len = lexer->end - keep;
+    size_t cursor = lexer->cursor - keep;
+    size_t tok = lexer->tok ? (size_t)(lexer->tok - keep) : 0;
+    js_lexer_index_lines(lexer, lexer->base + drop);
+    memmove(lexer->buf, keep, len);
+    if(len + JS_LEXER_CHUNK > lexer->buf_cap) {
+        // Tokens spanning more than the whole buffer
+        lexer->buf_cap = lexer->buf_cap * 2 + JS_LEXER_CHUNK;
+        lexer->buf = realloc(lexer->buf, lexer->buf_cap);
+        assert(lexer->buf && "Just buy more RAM");
+    }
+    lexer->base += drop;
+    lexer->src = lexer->buf;
+    lexer->end = lexer->buf + len;
+    lexer->cursor = lexer->buf + cursor;
+    if(lexer->tok) lexer->tok = lexer->buf + tok;
+    size_t n = lexer->read(lexer->read_ctx, lexer->buf + len, lexer->buf_cap - len);
+    if(n == 0) {
+        lexer->read_eof = true;
+        return false;
+    }
+    assert(lexer->base + (lexer->end - lexer->src) + n <= UINT32_MAX && "Inputs over 4GiB are not supported");
+    lexer->end += n;
+    return true;
+}
+static inline bool js_lexer_more(JsLexer* lexer) {
+    return lexer->cursor < lexer->end || js_lexer_refill(lexer);
+}
+// Byte classes for the lexer's ASCII fast paths. Whitespace goes through scan_skip_space.
+// Everything >= 0x80 is 0, those bytes go through utf8_next
+enum {
+    JS_CHAR_ALPHA   = 1 << 0,
+    JS_CHAR_DIGIT   = 1 << 1,
+};
+#define A JS_CHAR_ALPHA
+#define D JS_CHAR_DIGIT
+static const uint8_t js_char_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A,
+    0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,
+};
+#undef A
+#undef D
+static uint32_t js_lexer_next_char(JsLexer* lexer) {
+    return utf8_next(&lexer->cursor, lexer->end);
 }
 static void js_lexer_trim(JsLexer* lexer) {
-    while (lexer->cursor < lexer->end && isspace(js_lexer_peak_char(lexer))) js_lexer_next_char(lexer);
-}
-static bool iswordc(uint32_t codepoint) {
-    return codepoint == '_' || isalnum(codepoint);
-}
-static int jsparse_str(JsLexer* lexer, ScratchBuf* scratch) {
-    int chr;
-    bool escape = false;
-    while(lexer->cursor < lexer->end) {
-        chr = js_lexer_next_char(lexer);
-        if(chr == '\n') return -JSERR_INVALID_STRING;
-        if(chr == '"' && !escape) break;
-        if(escape) {
-            switch(chr) {
+    for(;;) {
+        lexer->cursor = scan_skip_space(lexer->cursor, lexer->end);
+        if(lexer->cursor < lexer->end || !js_lexer_refill(lexer)) return;
+    }
+}
+// Byte n past the cursor, 0 past the end of the input
+static uint8_t js_lexer_peak_byte(JsLexer* lexer, size_t n) {
+    while((size_t)(lexer->end - lexer->cursor) <= n) {
+        if(!js_lexer_refill(lexer)) return 0;
+    }
+    return lexer->cursor[n];
+}
+// Consumes [A-Za-z0-9_]* and any non-ASCII codepoint.
+// TODO: Unicode ID_Start/ID_Continue, for now everything >= 0x80 counts as a letter.
+// Returns false on malformed UTF-8
+static bool js_lexer_skip_word(JsLexer* lexer) {
+    for(;;) {
+        lexer->cursor = scan_skip_word(lexer->cursor, lexer->end);
+        uint8_t c = js_lexer_peak_byte(lexer, 0);
+        if(c < 0x80) return true;
+        size_t n = (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+        if(!n) return false;
+        for(size_t i = 1; i < n; ++i) {
+            if((js_lexer_peak_byte(lexer, i) & 0xC0) != 0x80) return false;
+        }
+        lexer->cursor += n;
+    }
+}
+static inline bool js_char_is_digit(uint8_t c) {
+    return js_char_class[c] & JS_CHAR_DIGIT;
+}
+static void js_lexer_skip_digits(JsLexer* lexer) {
+    while(js_char_is_digit(js_lexer_peak_byte(lexer, 0))) lexer->cursor++;
+}
+// Consumes a decimal literal (12, 1.5, .5, 5., 1e-3) and parses it.
+// Always starts at a digit or a '.' followed by one
+static int js_lexer_lex_number(JsLexer* lexer, double* number) {
+    js_lexer_skip_digits(lexer);
+    if(js_lexer_peak_byte(lexer, 0) == '.') {
+        lexer->cursor++;
+        js_lexer_skip_digits(lexer);
+    }
+    if((js_lexer_peak_byte(lexer, 0) | 0x20) == 'e') {
+        size_t n = 1;
+        if(js_lexer_peak_byte(lexer, n) == '+' || js_lexer_peak_byte(lexer, n) == '-') n++;
+        // Otherwise the 'e' starts the next token
+        if(js_char_is_digit(js_lexer_peak_byte(lexer, n))) {
+            lexer->cursor += n;
+            js_lexer_skip_digits(lexer);
+        }
+    }
+    return number_parse(lexer->tok, lexer->cursor, number) ? 0 : -JSERR_INVALID_NUMBER;
+}
+// Appends one decoded byte of a string literal
+#define JS_STR_PUSH(c) da_push_arena(&lexer->strs, &out, c)
+// Reads the rest of a string literal, the opening '"' is already consumed.
+// Literals without escapes point straight into the source unless it's streamed (the window moves).
+// Everything else gets decoded into lexer->strs
+static int jsparse_str(JsLexer* lexer, const char** data, size_t* len) {
+    const char* p = scan_skip_str(lexer->cursor, lexer->end);
+    if(!lexer->read && p < lexer->end && *p == '"') {
+        *data = lexer->cursor;
+        *len = p - lexer->cursor;
+        lexer->cursor = p + 1;
+        return 0;
+    }
+    ArenaMark mark = arena_mark(&lexer->strs);
+    struct {
+        char* items;
+        size_t len, cap;
+    } out = { 0 };
+    int e;
+    for(;;) {
+        // Plain runs get copied in one go
+        p = scan_skip_str(lexer->cursor, lexer->end);
+        size_t n = p - lexer->cursor;
+        if(n) {
+            da_reserve_arena(&lexer->strs, &out, n);
+            memcpy(out.items + out.len, lexer->cursor, n);
+            out.len += n;
+        }
+        lexer->cursor = p;
+        if(!js_lexer_more(lexer)) {
+            e = -JSERR_INVALID_STRING;
+            goto FAIL;
+        }
+        uint32_t chr = js_lexer_next_char(lexer);
+        switch(chr) {
+        case '"':
+            *data = out.items ? out.items : "";
+            *len = out.len;
+            return 0;
+        case '\n':
+        case '\r':
+            e = -JSERR_INVALID_STRING;
+            goto FAIL;
+        case '\\':
+            if(!js_lexer_more(lexer)) {
+                e = -JSERR_INVALID_STRING;
+                goto FAIL;
+            }
+            switch(chr = js_lexer_next_char(lexer)) {
             case 't':
-                scratchbuf_push(scratch, '\t');
+                JS_STR_PUSH('\t');
                 break;
             case 'n':
-                scratchbuf_push(scratch, '\n');
+                JS_STR_PUSH('\n');
                 break;
             case 'r':
-                scratchbuf_push(scratch, '\r');
+                JS_STR_PUSH('\r');
                 break;
             case '0':
-                scratchbuf_push(scratch, '\0');
+                JS_STR_PUSH('\0');
                 break;
+            case '\n':
+            case '\r':
+                e = -JSERR_INVALID_STRING;
+                goto FAIL;
             default:
-                if(chr >= 256) return -JSERR_INVALID_CHAR_IN_STRING;
-                scratchbuf_push(scratch, chr);
+                if(chr >= 256) {
+                    e = -JSERR_INVALID_CHAR_IN_STRING;
+                    goto FAIL;
+                }
+                JS_STR_PUSH(chr);
                 break;
             }
-        } else {
-            if(chr == '\\') escape = true;
-            else if(chr >= 256) return -JSERR_INVALID_CHAR_IN_STRING;
-            else scratchbuf_push(scratch, chr);
+            break;
+        default:
+            if(chr >= 256) {
+                e = -JSERR_INVALID_CHAR_IN_STRING;
+                goto FAIL;
+            }
+            JS_STR_PUSH(chr);
+            break;
         }
     }
-    if(lexer->cursor >= lexer->end) return -JSERR_INVALID_STRING;
-    return 0;
-}
-#define MAKE_TOKEN(...) (JsToken) { lexer->path, l0, c0, lexer->l, lexer->c, .kind=__VA_ARGS__ }
-static char* str_alloc(JsLexer* lexer, const char* data, size_t n) {
-    if(lexer->str_buffer_head + n > lexer->str_buffer_cap) return NULL;
-    char* buffer = lexer->str_buffer + lexer->str_buffer_head;
-    lexer->str_buffer_head += n;
-    memcpy(buffer, data, n);
-    return buffer;
+FAIL:
+    arena_rewind(&lexer->strs, mark);
+    return e;
 }
-JsToken js_lexer_next(JsLexer* lexer) {
+#undef JS_STR_PUSH
+#define MAKE_TOKEN(...) (JsToken) { \
+        .offset=lexer->base + (lexer->tok - lexer->src), \
+        .len=lexer->cursor - lexer->tok, \
+        .kind=__VA_ARGS__ \
+    }
+static JsToken js_lexer_lex(JsLexer* lexer) {
     js_lexer_trim(lexer);
-    size_t l0 = lexer->l, c0 = lexer->c;
-    if(lexer->cursor >= lexer->end) return MAKE_TOKEN(-JSERR_EOF);
-    int chr;
-    switch(chr=js_lexer_peak_char(lexer)) {
+    lexer->tok = lexer->cursor;
+    if(!js_lexer_more(lexer)) return MAKE_TOKEN(-JSERR_EOF);
+    // Everything that starts a token is ASCII, except for identifiers
+    uint8_t chr;
+    switch(chr=*lexer->cursor) {
     case '.':
+        if(js_char_is_digit(js_lexer_peak_byte(lexer, 1))) goto NUMBER;
+    // fallthrough
     case '(':
     case ')':
     case '+':
@@ -127,32 +401,30 @@ JsToken js_lexer_next(JsLexer* lexer) {
     case '*':
     case '/':
     case ',':
-        js_lexer_next_char(lexer);
+        lexer->cursor++;
         return MAKE_TOKEN(chr);
     case '"': {
-        ScratchBuf scratch;
-        scratchbuf_init(&scratch);
-        js_lexer_next_char(lexer);
-        int e = jsparse_str(lexer, &scratch);
-        if(e < 0) {
-            scratchbuf_cleanup(&scratch);
-            return MAKE_TOKEN(e);
-        }
-        char* str = str_alloc(lexer, scratch.data, scratch.len);
-        size_t len = scratch.len;
-        scratchbuf_cleanup(&scratch);
+        lexer->cursor++;
+        const char* str;
+        size_t len;
+        int e = jsparse_str(lexer, &str, &len);
+        if(e < 0) return MAKE_TOKEN(e);
         return MAKE_TOKEN(JSTOKEN_STR, .as = { .str = { str, len }});
     } break;
     default:
-        if(isalpha(chr) || chr == '_') {
-            const char* start = lexer->cursor;
-            while (lexer->cursor < lexer->end && iswordc(js_lexer_peak_char(lexer))) js_lexer_next_char(lexer);
-            Atom* atom = atom_table_get(lexer->atom_table, start, lexer->cursor-start);
-            if(!atom) {
-                atom = atom_new(start, lexer->cursor-start);
-                assert(atom && "Just buy more RAM");
-                atom_table_insert(lexer->atom_table, atom);
-            }
+        if(js_char_is_digit(chr)) {
+        NUMBER:;
+            double number;
+            int e = js_lexer_lex_number(lexer, &number);
+            if(e < 0) return MAKE_TOKEN(e);
+            return MAKE_TOKEN(JSTOKEN_NUMBER, .as = { .number = number });
+        }
+        if(chr >= 0x80 || js_char_class[chr] & JS_CHAR_ALPHA) {
+            if(!js_lexer_skip_word(lexer)) return MAKE_TOKEN(-JSERR_INVALID_UTF8);
+            assert(lexer->cursor > lexer->tok && "Identifiers can't be empty");
+            int kw = js_keyword_lookup(lexer->tok, lexer->cursor-lexer->tok);
+            if(kw >= 0) return MAKE_TOKEN(JSTOKEN_KEYWORD_FIRST + kw, .as = { .atom = js_keyword_atoms[kw] });
+            Atom* atom = atom_table_get_or_insert_new(lexer->atom_table, lexer->tok, lexer->cursor-lexer->tok);
             return MAKE_TOKEN(JSTOKEN_ATOM, .as = { .atom = atom });
         }
         break;
@@ -160,62 +432,240 @@ JsToken js_lexer_next(JsLexer* lexer) {
     fprintf(stderr, "TBD: parse `%c`\n", chr);
     abort();
 }
-typedef struct {
-    size_t l, c;
-    const char* cursor;
-    size_t str_buffer_head;
-} JsSnapshot;
-JsSnapshot js_lexer_snap_take(JsLexer* lexer) {
-    return (JsSnapshot) {
-        lexer->l, lexer->c,
-        lexer->cursor,
-        lexer->str_buffer_head
+static void js_token_stream_push(JsTokenStream* ts, const JsToken* t) {
+    uint32_t value = 0;
+    if(js_token_has_value(t->kind)) {
+        value = ts->values.len;
+        da_push(&ts->values, t->as);
+    }
+    da_push(&ts->kinds, t->kind);
+    da_push(&ts->offsets, t->offset);
+    da_push(&ts->lens, t->len);
+    da_push(&ts->value_index, value);
+}
+static JsToken js_token_stream_get(const JsTokenStream* ts, size_t i) {
+    if(i >= ts->kinds.len) return ts->last;
+    JsToken t = {
+        .kind = ts->kinds.items[i],
+        .offset = ts->offsets.items[i],
+        .len = ts->lens.items[i],
     };
+    if(js_token_has_value(t.kind)) t.as = ts->values.items[ts->value_index.items[i]];
+    else if(js_token_is_keyword(t.kind)) t.as.atom = js_keyword_atoms[t.kind - JSTOKEN_KEYWORD_FIRST];
+    return t;
 }
-void js_lexer_snap_restore(JsLexer* lexer, const JsSnapshot* snapshot) {
-    lexer->l = snapshot->l;
-    lexer->c = snapshot->c;
-    lexer->cursor = snapshot->cursor;
-    lexer->str_buffer_head = snapshot->str_buffer_head;
+static void js_lexer_lex_all(JsLexer* lexer, JsTokenStream* ts) {
+    JsToken t;
+    while((t = js_lexer_lex(lexer)).kind >= 0) js_token_stream_push(ts, &t);
+    ts->last = t;
 }
 JsToken js_lexer_peak(JsLexer* lexer, size_t ahead) {
-    JsSnapshot snap = js_lexer_snap_take(lexer);
-    JsToken t={0};
-    do {
-        t = js_lexer_next(lexer);
-    } while(ahead--);
-    js_lexer_snap_restore(lexer, &snap);
+    if(lexer->stream) return js_token_stream_get(lexer->stream, lexer->stream_pos + ahead);
+    assert(ahead < JS_LEXER_LOOKAHEAD && "Bump JS_LEXER_LOOKAHEAD");
+    while(lexer->ahead_len <= ahead) {
+        lexer->ahead[(lexer->ahead_head + lexer->ahead_len) & (JS_LEXER_LOOKAHEAD-1)] = js_lexer_lex(lexer);
+        lexer->ahead_len++;
+    }
+    return lexer->ahead[(lexer->ahead_head + ahead) & (JS_LEXER_LOOKAHEAD-1)];
+}
+JsToken js_lexer_next(JsLexer* lexer) {
+    if(lexer->stream) {
+        JsToken t = js_token_stream_get(lexer->stream, lexer->stream_pos);
+        if(lexer->stream_pos < lexer->stream->kinds.len) lexer->stream_pos++;
+        // Lexing stopped at the error, there's nothing after it
+        else lexer->stream->last.kind = -JSERR_EOF;
+        return t;
+    }
+    if(lexer->ahead_len == 0) return js_lexer_lex(lexer);
+    JsToken t = lexer->ahead[lexer->ahead_head];
+    lexer->ahead_head = (lexer->ahead_head + 1) & (JS_LEXER_LOOKAHEAD-1);
+    lexer->ahead_len--;
     return t;
 }
+// Frees decoded literals once nothing in the lookahead can point into them anymore.
+// Whatever the parser consumed is expected to be copied out by now
+static void js_lexer_release_strs(JsLexer* lexer) {
+    // All of them are still in the stream
+    if(lexer->stream) return;
+    for(size_t i = 0; i < lexer->ahead_len; ++i) {
+        if(lexer->ahead[(lexer->ahead_head + i) & (JS_LEXER_LOOKAHEAD-1)].kind == JSTOKEN_STR) return;
+    }
+    arena_reset(&lexer->strs);
+}
 static JsToken js_lexer_peak_next(JsLexer* lexer) {
     return js_lexer_peak(lexer, 0);
 }
-void js_lexer_new(JsLexer* lexer, const char* path, const char* src, const char* end, AtomTable* atom_table, char* str_buffer, size_t str_buffer_cap) {
+void js_lexer_new(JsLexer* lexer, const char* path, const char* src, const char* end, AtomTable* atom_table) {
+    memset(lexer, 0, sizeof(*lexer));
+    lexer->src = src;
     lexer->cursor = src;
     lexer->end = end;
-    lexer->l = 1;
-    lexer->c = 0;
+    assert((size_t)(end - src) <= UINT32_MAX && "Inputs over 4GiB are not supported");
+    da_push(&lexer->lines, 0);
     lexer->path = path;
     lexer->atom_table = atom_table;
-    lexer->str_buffer = str_buffer;
-    lexer->str_buffer_head = 0;
-    lexer->str_buffer_cap = str_buffer_cap;
+}
+// Lexes the input as it comes out of read, JS_LEXER_CHUNK bytes at a time
+void js_lexer_new_stream(JsLexer* lexer, const char* path, JsLexerRead read, void* read_ctx, AtomTable* atom_table) {
+    js_lexer_new(lexer, path, NULL, NULL, atom_table);
+    lexer->buf_cap = JS_LEXER_CHUNK * 2;
+    lexer->buf = malloc(lexer->buf_cap);
+    assert(lexer->buf && "Just buy more RAM");
+    lexer->src = lexer->cursor = lexer->end = lexer->buf;
+    lexer->read = read;
+    lexer->read_ctx = read_ctx;
+}
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+// Every thread gets at least this much of the input
+#define JS_LEX_PARALLEL_MIN (1024*1024)
+#define JS_LEX_MAX_JOBS 64
+typedef struct {
+    JsLexer lexer;
+    AtomTable atom_table;
+    JsTokenStream tokens;
+} JsLexJob;
+static void* js_lex_job(void* arg) {
+    JsLexJob* job = arg;
+    js_lexer_lex_all(&job->lexer, &job->tokens);
+    return NULL;
+}
+// Appends a job's tokens to ts. Its atoms get re-interned into lexer's table
+// and its decoded strings copied into lexer's arena so the job can be freed
+static void js_lex_job_merge(JsLexer* lexer, JsTokenStream* ts, JsLexJob* job) {
+    JsTokenStream* from = &job->tokens;
+    size_t n = from->kinds.len, values_base = ts->values.len;
+    da_push_many(&ts->kinds, from->kinds.items, n);
+    da_push_many(&ts->offsets, from->offsets.items, n);
+    da_push_many(&ts->lens, from->lens.items, n);
+    da_reserve(&ts->value_index, n);
+    for(size_t i = 0; i < n; ++i) {
+        ts->value_index.items[ts->value_index.len++] = values_base + from->value_index.items[i];
+    }
+    da_push_many(&ts->values, from->values.items, from->values.len);
+    for(size_t i = 0; i < n; ++i) {
+        JsTokenValue* v = &ts->values.items[values_base + from->value_index.items[i]];
+        switch(from->kinds.items[i]) {
+        case JSTOKEN_ATOM:
+            v->atom = atom_table_intern(lexer->atom_table, v->atom);
+            break;
+        case JSTOKEN_STR: {
+            // Slices of the source can stay as they are
+            if(v->str.len == 0 || (v->str.data >= lexer->src && v->str.data < lexer->end)) break;
+            char* data = arena_alloc(&lexer->strs, v->str.len);
+            assert(data && "Just buy more RAM");
+            memcpy(data, v->str.data, v->str.len);
+            v->str.data = data;
+        } break;
+        }
+    }
+    ts->last = from->last;
+}
+static void js_lex_job_free(JsLexJob* job) {
+    free(job->lexer.lines.items);
+    arena_free(&job->lexer.strs);
+    atom_table_destroy(&job->atom_table);
+    free(job->tokens.kinds.items);
+    free(job->tokens.offsets.items);
+    free(job->tokens.lens.items);
+    free(job->tokens.value_index.items);
+    free(job->tokens.values.items);
+}
+// Splits the rest of the input into up to max_jobs pieces and lexes them on separate threads.
+// Returns false if the input isn't worth (or can't be) split
+static bool js_lexer_lex_all_parallel(JsLexer* lexer, JsTokenStream* ts, size_t max_jobs) {
+    if(lexer->read) return false;
+    size_t size = lexer->end - lexer->cursor;
+    size_t njobs = size / JS_LEX_PARALLEL_MIN;
+    if(njobs > max_jobs) njobs = max_jobs;
+    if(njobs > JS_LEX_MAX_JOBS) njobs = JS_LEX_MAX_JOBS;
+    if(njobs < 2) return false;
+    JsLexJob* jobs = calloc(njobs, sizeof(*jobs));
+    assert(jobs && "Just buy more RAM");
+    // No token can span a line (there are no comments or template literals),
+    // so every line start is a point where lexing can safely resume.
+    // TODO: validate split points speculatively once multi-line tokens exist
+    const char* start = lexer->cursor;
+    size_t count = 0;
+    while(count < njobs && start < lexer->end) {
+        const char* stop = lexer->end;
+        if(count + 1 < njobs) {
+            stop = lexer->cursor + size / njobs * (count + 1);
+            if(stop < start) stop = start;
+            stop = scan_skip_line(stop, lexer->end);
+            if(stop < lexer->end) stop++;
+        }
+        JsLexJob* job = &jobs[count++];
+        js_lexer_new(&job->lexer, lexer->path, start, stop, &job->atom_table);
+        job->lexer.base = lexer->base + (start - lexer->src);
+        start = stop;
+    }
+    pthread_t threads[JS_LEX_MAX_JOBS];
+    bool spawned[JS_LEX_MAX_JOBS] = { 0 };
+    for(size_t i = 1; i < count; ++i) {
+        spawned[i] = pthread_create(&threads[i], NULL, js_lex_job, &jobs[i]) == 0;
+        if(!spawned[i]) js_lex_job(&jobs[i]);
+    }
+    js_lex_job(&jobs[0]);
+    for(size_t i = 1; i < count; ++i) {
+        if(spawned[i]) pthread_join(threads[i], NULL);
+    }
+    // The first error ends the stream just like it does when lexing sequentially
+    for(size_t i = 0; i < count; ++i) {
+        if(ts->last.kind != -JSERR_EOF && i > 0) break;
+        js_lex_job_merge(lexer, ts, &jobs[i]);
+    }
+    for(size_t i = 0; i < count; ++i) js_lex_job_free(&jobs[i]);
+    free(jobs);
+    lexer->cursor = lexer->end;
+    return true;
+}
+static size_t js_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+#else
+static bool js_lexer_lex_all_parallel(JsLexer*, JsTokenStream*, size_t) {
+    return false;
+}
+static size_t js_cpu_count(void) {
+    return 1;
+}
+#endif
+// Lexes the rest of the input in one go, on up to max_jobs threads for big inputs.
+// Afterwards js_lexer_next and js_lexer_peak just index into ts (with unbounded lookahead)
+void js_lexer_pretokenize(JsLexer* lexer, JsTokenStream* ts, size_t max_jobs) {
+    assert(lexer->ahead_len == 0 && "Pretokenize before peeking");
+    if(!js_lexer_lex_all_parallel(lexer, ts, max_jobs)) js_lexer_lex_all(lexer, ts);
+    lexer->stream = ts;
+    lexer->stream_pos = 0;
 }
 void js_token_dump(FILE* sink, JsToken* t) {
     switch(t->kind) {
     case JSTOKEN_ATOM:
         fprintf(sink, "%s", t->as.atom->data);
         break;
+    #define X(NAME, name) case JSTOKEN_##NAME:
+    JS_KEYWORDS
+    #undef X
+        fprintf(sink, "keyword %s", t->as.atom->data);
+        break;
     case JSTOKEN_STR:
         fprintf(sink, "\"%.*s\"", (int)t->as.str.len, t->as.str.data);
         break;
+    case JSTOKEN_NUMBER: {
+        char buf[NUMBER_FORMAT_MAX];
+        number_format(t->as.number, buf);
+        fprintf(sink, "%s", buf);
+    } break;
     default:
         if(t->kind < 0) {
             // TODO: proper error logging with a 
             // strtab
             fprintf(sink, "ERROR(%d)", -t->kind);
         }
-        else if(t->kind < 256) fprintf(sink, "%c", t->kind);
+        else if(t->kind < JSTOKEN_ATOM) fprintf(sink, "%c", t->kind);
         else fprintf(sink, "Token(%d)", t->kind);
         break;
     }
@@ -232,6 +682,8 @@ enum {
     JSAST_BINOP,
     JSAST_ATOM,
     JSAST_CALL,
+    JSAST_NUMBER,
+    JSAST_KEYWORD,
     JSAST_COUNT
 };
 typedef struct JsAST JsAST;
@@ -239,9 +691,9 @@ typedef struct {
     JsAST** items;
     size_t len, cap;
 } JsCallArgs;
-static void js_call_args_dealloc(JsCallArgs* args) {
-    free(args->items);
-}
+// Arguments get collected in here and frozen into the AST arena
+// once the call is parsed.
+static Arena js_parse_scratch = { 0 };
 struct JsAST {
     // size_t l0, c0, l1, c1;
     int kind;
@@ -250,6 +702,9 @@ struct JsAST {
         struct { int op; JsAST *lhs, *rhs; } binop;
         struct { const char* data; size_t len; } str;
         struct { JsAST* what; JsCallArgs args; } call;
+        double number;
+        // JSTOKEN_THIS, JSTOKEN_TRUE, ...
+        int keyword;
     } as;
 };
 JsAST* js_ast_new_binop(Arena* arena, int op, JsAST* lhs, JsAST* rhs) {
@@ -269,6 +724,20 @@ JsAST* js_ast_new_str(Arena* arena, const char* data, size_t len) {
     ast->as.str.len = len;
     return ast;
 }
+JsAST* js_ast_new_number(Arena* arena, double number) {
+    JsAST* ast = arena_alloc(arena, sizeof(*ast));
+    if(!ast) return NULL;
+    ast->kind = JSAST_NUMBER;
+    ast->as.number = number;
+    return ast;
+}
+JsAST* js_ast_new_keyword(Arena* arena, int keyword) {
+    JsAST* ast = arena_alloc(arena, sizeof(*ast));
+    if(!ast) return NULL;
+    ast->kind = JSAST_KEYWORD;
+    ast->as.keyword = keyword;
+    return ast;
+}
 JsAST* js_ast_new_atom(Arena* arena, Atom* atom) {
     JsAST* ast = arena_alloc(arena, sizeof(*ast));
     if(!ast) return NULL;
@@ -284,23 +753,49 @@ JsAST* js_ast_new_call(Arena* arena, JsAST* what, JsCallArgs args) {
     ast->as.call.args = args;
     return ast;
 }
+// Property names can be keywords too (x.default, p.catch)
+JsAST* js_parse_member_name(JsLexer* l, Arena* arena) {
+    JsToken t = js_lexer_next(l);
+    if(t.kind == JSTOKEN_ATOM || js_token_is_keyword(t.kind)) return js_ast_new_atom(arena, t.as.atom);
+    js_lexer_print_loc(stderr, l, t.offset);
+    fprintf(stderr, "JS:ERROR Expected a property name after '.' but found: ");
+    js_token_dump(stderr, &t);
+    fprintf(stderr, "\n");
+    return NULL;
+}
 JsAST* js_parse_basic(JsLexer* l, Arena* arena) {
     (void)arena;
     JsToken t = js_lexer_next(l);
     switch(t.kind) {
     case JSTOKEN_STR:
         return js_ast_new_str(arena, t.as.str.data, t.as.str.len);
+    case JSTOKEN_NUMBER:
+        return js_ast_new_number(arena, t.as.number);
     case JSTOKEN_ATOM:
         return js_ast_new_atom(arena, t.as.atom);
+    case JSTOKEN_THIS:
+    case JSTOKEN_TRUE:
+    case JSTOKEN_FALSE:
+    case JSTOKEN_NULL:
+        return js_ast_new_keyword(arena, t.kind);
     }
+    js_lexer_print_loc(stderr, l, t.offset);
     fprintf(stderr, "JS:ERROR Unexpected token: ");
     js_token_dump(stderr, &t);
     fprintf(stderr, "\n");
     return NULL;
 }
 void js_ast_dump(FILE* sink, JsAST* ast) {
-    static_assert(JSAST_COUNT == 4, "Update js_ast_dump");
+    static_assert(JSAST_COUNT == 6, "Update js_ast_dump");
     switch(ast->kind) {
+    case JSAST_KEYWORD:
+        fprintf(sink, "%s", js_keyword_atoms[ast->as.keyword - JSTOKEN_KEYWORD_FIRST]->data);
+        break;
+    case JSAST_NUMBER: {
+        char buf[NUMBER_FORMAT_MAX];
+        number_format(ast->as.number, buf);
+        fprintf(sink, "%s", buf);
+    } break;
     case JSAST_ATOM:
         fprintf(sink, "%s", ast->as.atom->data);
         break;
@@ -358,7 +853,10 @@ int js_binop_prec(int op) {
 JsAST* js_parse_ast(JsLexer* l, Arena* arena, int expr_precedence);
 JsAST* js_parse_astcall(JsLexer* l, Arena* arena, JsAST* what) {
     JsToken t;
+    ArenaMark mark = arena_mark(arena);
+    ArenaMark scratch_mark = arena_mark(&js_parse_scratch);
     if((t=js_lexer_next(l)).kind != '(') {
+        js_lexer_print_loc(stderr, l, t.offset);
         fprintf(stderr, "JS:ERROR Expected '(' in function call\n");
         return NULL;
     }
@@ -368,37 +866,43 @@ JsAST* js_parse_astcall(JsLexer* l, Arena* arena, JsAST* what) {
         if(t.kind == ')') break;
         JsAST* value = js_parse_ast(l, arena, JS_INIT_PRECEDENCE);
         if(!value) {
-            js_call_args_dealloc(&args);
+            arena_rewind(&js_parse_scratch, scratch_mark);
+            arena_rewind(arena, mark);
             return NULL;
         }
-        da_push(&args, value);
+        da_push_arena(&js_parse_scratch, &args, value);
         t = js_lexer_peak_next(l);
         if(t.kind == ')') break;
         else if (t.kind == ',') js_lexer_next(l);
         else {
-            // TODO: error reporting (path:line:chr)
+            js_lexer_print_loc(stderr, l, t.offset);
             fprintf(stderr, "JS:ERROR Expected ')' or ',' in function call but found other\n");
-            js_call_args_dealloc(&args);
+            arena_rewind(&js_parse_scratch, scratch_mark);
+            arena_rewind(arena, mark);
             return NULL;
         }
     } 
     if((t=js_lexer_next(l)).kind != ')') {
+        js_lexer_print_loc(stderr, l, t.offset);
         fprintf(stderr, "JS:ERROR Expected ')' in function call\n");
-        js_call_args_dealloc(&args);
+        arena_rewind(&js_parse_scratch, scratch_mark);
+        arena_rewind(arena, mark);
         return NULL;
     }
+    da_freeze_arena(arena, &args);
+    arena_rewind(&js_parse_scratch, scratch_mark);
     return js_ast_new_call(arena, what, args);
 }
-JsAST* js_parse_ast(JsLexer* l, Arena* arena, int expr_precedence) {
+// Keeps parsing operators applied to v as long as they bind tighter than expr_precedence
+JsAST* js_parse_ast_rhs(JsLexer* l, Arena* arena, JsAST* v, int expr_precedence) {
     JsToken t;
-    JsAST* v = js_parse_basic(l, arena);
-    if(!v) return NULL;
     for(;;) {
         t = js_lexer_peak_next(l);
         switch(t.kind) {
         case '(': {
             if(2 > expr_precedence) return v;
             v = js_parse_astcall(l, arena, v);
+            if(!v) return NULL;
         } break;
         #define X(op) case op:
         JS_BINOPS
@@ -408,8 +912,7 @@ JsAST* js_parse_ast(JsLexer* l, Arena* arena, int expr_precedence) {
             int bin_precedence = js_binop_prec(binop);
             if(bin_precedence > expr_precedence) return v;
             js_lexer_next(l);
-            JsSnapshot snap = js_lexer_snap_take(l);
-            JsAST* v2 = js_parse_basic(l, arena);
+            JsAST* v2 = binop == '.' ? js_parse_member_name(l, arena) : js_parse_basic(l, arena);
             if(!v2) return NULL;
             t = js_lexer_peak_next(l);
             int next_prec = -1;
@@ -424,9 +927,10 @@ JsAST* js_parse_ast(JsLexer* l, Arena* arena, int expr_precedence) {
                 next_prec = 2;
                 break;
             }
+            // Only operators binding strictly tighter go to the right, keeps a-b-c left associative
             if (bin_precedence > next_prec) {
-                js_lexer_snap_restore(l, &snap);
-                v2 = js_parse_ast(l, arena, bin_precedence);
+                v2 = js_parse_ast_rhs(l, arena, v2, bin_precedence-1);
+                if(!v2) return NULL;
             }
             v = js_ast_new_binop(arena, binop, v, v2);
         } break;
@@ -436,6 +940,11 @@ JsAST* js_parse_ast(JsLexer* l, Arena* arena, int expr_precedence) {
     }
     return v;
 }
+JsAST* js_parse_ast(JsLexer* l, Arena* arena, int expr_precedence) {
+    JsAST* v = js_parse_basic(l, arena);
+    if(!v) return NULL;
+    return js_parse_ast_rhs(l, arena, v, expr_precedence);
+}
 enum {
     JSSTATEMENT_EVAL,
 };
@@ -453,42 +962,39 @@ JsStatement* js_statement_new_eval(Arena* arena, JsAST* ast) {
     return stmt;
 }
 JsStatement* js_parse_statement(JsLexer* l, Arena* arena) {
+    // Don't keep around half parsed statements
+    ArenaMark mark = arena_mark(arena);
     JsAST* ast = js_parse_ast(l, arena, JS_INIT_PRECEDENCE);
-    if(!ast) return NULL;
+    if(!ast) {
+        arena_rewind(arena, mark);
+        return NULL;
+    }
     return js_statement_new_eval(arena, ast);
 }
-typedef struct {
-    JsStatement** items;
-    size_t len, cap;
-} JsStatements;
-typedef struct {
-    JsVmInstruction* items;
-    size_t len, cap;
-} JsVmInstructions;
-void js_compile_ast(JsVmInstructions* insts, JsAST* ast) {
-    (void)insts;
-    static_assert(JSAST_COUNT == 4, "Update js_compile_ast");
+void js_compile_ast(JsVmUnit* unit, JsVmGlobals* globals, JsAST* ast) {
+    static_assert(JSAST_COUNT == 6, "Update js_compile_ast");
     switch(ast->kind) {
     case JSAST_ATOM: {
         // TODO: locals :)
-        JsVmInstruction inst = {
-            .kind = JSVM_GET_GLOBAL,
-            .as = {
-                .atom = ast->as.atom
-            }
-        };
-        da_push(insts, inst);
+        jsvm_emit_op(unit, JSVM_GET_GLOBAL);
+        jsvm_emit_uint(unit, jsvm_globals_resolve(globals, ast->as.atom));
     } break;
     case JSAST_BINOP: {
         switch(ast->as.binop.op) {
         case '.': {
             assert(ast->as.binop.rhs->kind == JSAST_ATOM);
-            js_compile_ast(insts, ast->as.binop.lhs);
-            JsVmInstruction inst = {
-                .kind = JSVM_GET_MEMBER,
-                .as.atom = ast->as.binop.rhs->as.atom
-            };
-            da_push(insts, inst);
+            js_compile_ast(unit, globals, ast->as.binop.lhs);
+            jsvm_emit_op(unit, JSVM_GET_MEMBER);
+            jsvm_emit_uint(unit, jsvm_unit_add_member(unit, ast->as.binop.rhs->as.atom));
+        } break;
+        case '+':
+        case '-':
+        case '*':
+        case '/': {
+            js_compile_ast(unit, globals, ast->as.binop.lhs);
+            js_compile_ast(unit, globals, ast->as.binop.rhs);
+            static const uint8_t ops[] = { ['+'] = JSVM_ADD, ['-'] = JSVM_SUB, ['*'] = JSVM_MUL, ['/'] = JSVM_DIV };
+            jsvm_emit_op(unit, ops[ast->as.binop.op]);
         } break;
         default:
             todof("js_compile_ast binop=%c", ast->as.binop.op);
@@ -496,44 +1002,46 @@ void js_compile_ast(JsVmInstructions* insts, JsAST* ast) {
     } break;
     case JSAST_CALL: {
         for(size_t i = ast->as.call.args.len; i > 0; --i) {
-            js_compile_ast(insts, ast->as.call.args.items[i-1]);
+            js_compile_ast(unit, globals, ast->as.call.args.items[i-1]);
         }
         if(ast->as.call.what->kind == JSAST_BINOP && ast->as.call.what->as.binop.op == '.') {
-            js_compile_ast(insts, ast->as.call.what->as.binop.lhs);
-            da_push(insts, ((JsVmInstruction) {
-                .kind = JSVM_DUP,
-            }));
-            da_push(insts, ((JsVmInstruction) {
-                .kind = JSVM_GET_MEMBER,
-                .as.atom = ast->as.call.what->as.binop.rhs->as.atom
-            }));
-            JsVmInstruction inst = {
-                .kind = JSVM_CALL,
-                .as.call.num_args = ast->as.call.args.len,
-            };
-            da_push(insts, inst);
+            js_compile_ast(unit, globals, ast->as.call.what->as.binop.lhs);
+            jsvm_emit_op(unit, JSVM_DUP);
+            jsvm_emit_op(unit, JSVM_GET_MEMBER);
+            jsvm_emit_uint(unit, jsvm_unit_add_member(unit, ast->as.call.what->as.binop.rhs->as.atom));
+            jsvm_emit_op(unit, JSVM_CALL);
+            jsvm_emit_uint(unit, ast->as.call.args.len);
             break;
         }
-        da_push(insts, ((JsVmInstruction) {
-            .kind = JSVM_THIS
-        }));
-        js_compile_ast(insts, ast->as.call.what);
-        JsVmInstruction inst = {
-            .kind = JSVM_CALL,
-            .as.call.num_args = ast->as.call.args.len,
-        };
-        da_push(insts, inst);
+        jsvm_emit_op(unit, JSVM_THIS);
+        js_compile_ast(unit, globals, ast->as.call.what);
+        jsvm_emit_op(unit, JSVM_CALL);
+        jsvm_emit_uint(unit, ast->as.call.args.len);
     } break;
     case JSAST_STRING: {
-        JsVmInstruction inst = {
-            .kind = JSVM_PUSH_STR,
-            .as.push_str = {
-                .data = ast->as.str.data,
-                .len = ast->as.str.len,
-            }
-        };
-        da_push(insts, inst);
+        jsvm_emit_op(unit, JSVM_PUSH_STR);
+        jsvm_emit_uint(unit, jsvm_unit_add_str(unit, ast->as.str.data, ast->as.str.len));
     } break;
+    case JSAST_NUMBER:
+        jsvm_emit_number(unit, ast->as.number);
+        break;
+    case JSAST_KEYWORD:
+        switch(ast->as.keyword) {
+        case JSTOKEN_THIS:
+            jsvm_emit_op(unit, JSVM_THIS);
+            break;
+        case JSTOKEN_TRUE:
+        case JSTOKEN_FALSE:
+            jsvm_emit_op(unit, JSVM_PUSH_BOOL);
+            jsvm_emit_uint(unit, ast->as.keyword == JSTOKEN_TRUE);
+            break;
+        case JSTOKEN_NULL:
+            jsvm_emit_op(unit, JSVM_PUSH_NULL);
+            break;
+        default:
+            todof("js_compile_ast keyword %d\n", ast->as.keyword);
+        }
+        break;
     default:
         todof("js_compile_ast(%d)\n", ast->kind);
     }
@@ -544,57 +1052,74 @@ static void jsruntime_console_log(JsVmValue*, JsVmValue*, JsVmStack* stack, size
         if(i > 0) printf(" ");
         assert(stack->len > 0);
         JsVmValue arg = da_pop(stack);
-        static_assert(JSVM_VALUE_COUNT == 4, "Update jsruntime_console_log");
-        switch(arg.kind) {
+        static_assert(JSVM_VALUE_COUNT == 8, "Update jsruntime_console_log");
+        switch(jsvm_value_kind(arg)) {
         case JSVM_VALUE_UNDEFINED:
             printf("undefined");
             break;
+        case JSVM_VALUE_NULL:
+        case JSVM_VALUE_BOOL:
+        case JSVM_VALUE_INT:
+        case JSVM_VALUE_NUMBER:
+            jsvm_dump_value(stdout, &arg);
+            break;
         case JSVM_VALUE_FUNC:
-            printf("<Function: #%08llx>", (unsigned long long)arg.as.func.func);
+            printf("<Function: #%08llx>", (unsigned long long)jsvm_value_as_func(arg));
             break;
         case JSVM_VALUE_OBJECT:
             jsvm_dump_value(stdout, &arg);
             break;
-        case JSVM_VALUE_STRING:
-            for(size_t i = 0; i < arg.as.string.len; ++i) {
-                char c = arg.as.string.items[i];
+        case JSVM_VALUE_STRING: {
+            JsVmString* string = jsvm_value_as_string(arg);
+            for(size_t i = 0; i < string->len; ++i) {
+                char c = string->data[i];
                 if(isprint(c)) printf("%c", c);
                 else printf("\\x%02X", c);
             }
-            break;
+        } break;
         }
     }
     printf("\n");
 }
 static void jsruntime_console_toString(JsVmValue*, JsVmValue*, JsVmStack* stack, size_t) {
-    JsVmValue value = {
-        .kind = JSVM_VALUE_STRING,
-        .as.string = { 0 }
-    };
-    da_reserve(&value.as.string, 256);
-    value.as.string.len += snprintf(value.as.string.items, value.as.string.cap, "[object console]");
+    static const char str[] = "[object console]";
     da_push(
         stack,
-        value
+        jsvm_value_string(jsvm_string_new(str, sizeof(str)-1))
     );
 }
+static size_t js_read_file(void* ctx, char* buf, size_t cap) {
+    return read_available((FILE*)ctx, buf, cap);
+}
 const char* shift_args(int *argc, char ***argv) {
     if((*argc) <= 0) return NULL;
     return ((*argc)--, *((*argv)++));
 }
 void help(FILE* sink, const char* exe) {
-    fprintf(sink, "%s ... (input path) ...\n", exe);
+    fprintf(sink, "%s [--pretokenize [--jobs <n>]] <input path or - for stdin>\n", exe);
+    fprintf(sink, "    --pretokenize  Lex the whole input before parsing\n");
+    fprintf(sink, "    --jobs <n>     Threads --pretokenize can split big inputs across (default: CPU count), needs --pretokenize\n");
 }
 int main(int argc, char** argv) {
     (void)argc;
     (void)argv;
-    size_t size;
     const char* path = NULL;
+    bool pretokenize = false;
+    size_t jobs = 0;
     const char* exe = shift_args(&argc, &argv);
     assert(exe);
     while(argc) {
         const char* arg = shift_args(&argc, &argv);
-        if(!path) path = arg;
+        if(strcmp(arg, "--pretokenize") == 0) pretokenize = true;
+        else if(strcmp(arg, "--jobs") == 0) {
+            const char* n = shift_args(&argc, &argv);
+            if(!n || (jobs = strtoul(n, NULL, 10)) == 0) {
+                fprintf(stderr, "Expected a positive number of jobs after --jobs\n");
+                help(stderr, exe);
+                return 1;
+            }
+        }
+        else if(!path) path = arg;
         else {
             fprintf(stderr, "Unexpected argument `%s`\n", arg);
             help(stderr, exe);
@@ -606,79 +1131,86 @@ int main(int argc, char** argv) {
         help(stderr, exe);
         return 1;
     }
+    if(jobs && !pretokenize) {
+        fprintf(stderr, "--jobs only does anything with --pretokenize\n");
+        help(stderr, exe);
+        return 1;
+    }
 
-    const char* content = read_entire_file(path, &size);
-    if(!content) return 1;
     JsLexer lexer = { 0 };
     Arena arena = { 0 };
     AtomTable atom_table = { 0 };
-    static char str_buffer[4096*4]; 
-    js_lexer_new(&lexer, path, content, content + size, &atom_table, str_buffer, sizeof(str_buffer));
+    js_atoms_init(&atom_table);
+    FileView content = { 0 };
+    // Piped input gets lexed, parsed and compiled as it arrives.
+    // The source itself doesn't have to fit in memory, the compiled program does
+    if(strcmp(path, "-") == 0) {
+        js_lexer_new_stream(&lexer, "<stdin>", js_read_file, stdin, &atom_table);
+    } else {
+        if(!map_entire_file(path, &content)) return 1;
+        js_lexer_new(&lexer, path, content.data, content.data + content.size, &atom_table);
+    }
+    JsTokenStream tokens = { 0 };
+    if(pretokenize) js_lexer_pretokenize(&lexer, &tokens, jobs ? jobs : js_cpu_count());
+    JsVmGlobals globals = { 0 };
+    {
+        JsVmObject* console = malloc(sizeof(*console));
+        assert(console && "Just buy more RAM");
+        memset(console, 0, sizeof(*console));
+
+        jsvm_object_insert(console,
+            JS_ATOM(log),
+            jsvm_value_func(jsruntime_console_log)
+        );
+        jsvm_object_insert(console,
+            JS_ATOM(toString),
+            jsvm_value_func(jsruntime_console_toString)
+        );
+        jsvm_globals_define(&globals,
+            JS_ATOM(console),
+            jsvm_value_object(console)
+        );
+    }
+    // Parsing is per statement but nothing runs until the whole input compiled cleanly,
+    // so the unit (bytecode and copies of every string literal) grows with the input.
+    // So does the lexer's line index. Only the ASTs and decoded literals get recycled
+    JsVmUnit unit = { 0 };
     JsToken t;
     size_t errors = 0;
-    JsStatements statements = { 0 };
     while((t=js_lexer_peak_next(&lexer)).kind >= 0) {
         switch(t.kind) {
         case ';':
             js_lexer_next(&lexer);
             break;
         default: {
+            // The AST and its literals are dead as soon as they're compiled
+            ArenaMark mark = arena_mark(&arena);
             JsStatement* stmt = js_parse_statement(&lexer, &arena);
             if(!stmt) {
                 errors++;
                 continue;
             }
-            da_push(&statements, stmt);
+            switch(stmt->kind) {
+            case JSSTATEMENT_EVAL:
+                js_compile_ast(&unit, &globals, stmt->as.ast);
+                break;
+            }
+            arena_rewind(&arena, mark);
+            js_lexer_release_strs(&lexer);
         } break;
         }
     }
     if(t.kind != -JSERR_EOF) {
+        js_lexer_print_loc(stderr, &lexer, t.offset);
         fprintf(stderr, "JS:ERROR Lexing: ");
         js_token_dump(stderr, &t);
         fprintf(stderr, "\n");
         errors++;
     }
+    // Everything that outlives compilation (atoms, constants) has been copied out of the source by now
+    unmap_file(&content);
     if(errors) return 1;
-    JsVmInstructions insts = { 0 };
-    for(size_t i = 0; i < statements.len; ++i) {
-        JsStatement* stmt = statements.items[i];
-        switch(stmt->kind) {
-        case JSSTATEMENT_EVAL:
-            js_compile_ast(&insts, stmt->as.ast);
-            break;
-        }
-    }
     JsVmStack stack = { 0 };
-    JsVmObject globals = { 0 };
-    {
-        JsVmObject* console = malloc(sizeof(*console));
-        assert(console && "Just buy more RAM");
-        memset(console, 0, sizeof(*console));
-
-        jsvm_object_insert(console,
-            atom_table_get_or_insert_new_cstr(&atom_table, "log"),
-            (JsVmValue) {
-                .kind = JSVM_VALUE_FUNC,
-                .as.func.func = jsruntime_console_log
-            }
-        );
-        jsvm_object_insert(console,
-            atom_table_get_or_insert_new_cstr(&atom_table, "toString"),
-            (JsVmValue) {
-                .kind = JSVM_VALUE_FUNC,
-                .as.func.func = jsruntime_console_toString,
-            }
-        );
-        jsvm_object_insert(&globals, 
-            atom_table_get_or_insert_new_cstr(&atom_table, "console"),
-            (JsVmValue) {
-                .kind = JSVM_VALUE_OBJECT,
-                .as.object = console
-            }
-        );
-    }
-    for(size_t i = 0; i < insts.len; ++i) {
-        jsvm_interpret(&globals, &stack, &insts.items[i]);
-    }
+    jsvm_run(&globals, &stack, &unit);
     return 0;
 }
@@ -0,0 +1,194 @@
+#include "number.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "number_pow10.h"
+
+// Every one of these is exactly representable
+static const double number_exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+// High 64 bits of a*b, the low ones go into *lo
+static inline uint64_t number_mul64(uint64_t a, uint64_t b, uint64_t* lo) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *lo = (uint64_t)r;
+    return (uint64_t)(r >> 64);
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32, b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t ll = a_lo * b_lo, lh = a_lo * b_hi, hl = a_hi * b_lo, hh = a_hi * b_hi;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    *lo = (mid << 32) | (uint32_t)ll;
+    return hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+static inline int number_clz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while(!(x >> 63)) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+// man * 10^exp10 for man != 0 and exp10 within the table.
+// Returns false when the 128 bit product is too close to a halfway point
+// (or the result is subnormal/infinite) to round correctly from here.
+// See Lemire, "Number Parsing at a Gigabyte per Second"
+static bool number_eisel_lemire(uint64_t man, int exp10, double* out) {
+    const uint64_t* pow10 = number_pow10[exp10 - NUMBER_POW10_MIN];
+    int clz = number_clz64(man);
+    man <<= clz;
+    // floor(log2(10) * exp10) for every exp10 in the table
+    uint64_t exp2 = (uint64_t)(((217706 * exp10) >> 16) + 64 + 1023 - clz);
+    uint64_t lo, hi = number_mul64(man, pow10[0], &lo);
+    // The low half of the power could carry into the bits we keep
+    if((hi & 0x1FF) == 0x1FF && lo + man < man) {
+        uint64_t lo2, hi2 = number_mul64(man, pow10[1], &lo2);
+        uint64_t merged_lo = lo + hi2, merged_hi = hi + (merged_lo < lo);
+        if((merged_hi & 0x1FF) == 0x1FF && merged_lo + 1 == 0 && lo2 + man < man) return false;
+        hi = merged_hi;
+        lo = merged_lo;
+    }
+    // Keep 54 bits, the extra one is for rounding
+    uint64_t msb = hi >> 63;
+    uint64_t mantissa = hi >> (msb + 9);
+    exp2 -= 1 ^ msb;
+    // Exactly halfway (as far as we can tell), round to even needs the real thing
+    if(lo == 0 && (hi & 0x1FF) == 0 && (mantissa & 3) == 1) return false;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if(mantissa >> 53) {
+        mantissa >>= 1;
+        exp2++;
+    }
+    // 0 is subnormal, 0x7FF and above (or wrapped around) is infinity
+    if(exp2 - 1 >= 0x7FF - 1) return false;
+    uint64_t bits = exp2 << 52 | (mantissa & 0x000FFFFFFFFFFFFFull);
+    memcpy(out, &bits, sizeof(*out));
+    return true;
+}
+// NOTE: strtod goes by the locale, we never call setlocale so it's always "C"
+static double number_parse_slow(const char* p, const char* end) {
+    char small[64];
+    size_t len = end - p;
+    char* buf = len < sizeof(small) ? small : malloc(len + 1);
+    assert(buf && "Just buy more RAM");
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    double value = strtod(buf, NULL);
+    if(buf != small) free(buf);
+    return value;
+}
+static inline bool number_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+bool number_parse(const char* p, const char* end, double* out) {
+    const char* start = p;
+    uint64_t man = 0;
+    // Significant digits. Only the first 19 are guaranteed to fit into man
+    size_t digits = 0;
+    int64_t exp10 = 0;
+    bool any = false;
+    for(; p < end && number_is_digit(*p); ++p) {
+        any = true;
+        if(man == 0 && *p == '0') continue;
+        if(digits++ < 19) man = man * 10 + (*p - '0');
+    }
+    if(p < end && *p == '.') {
+        for(++p; p < end && number_is_digit(*p); ++p) {
+            any = true;
+            exp10--;
+            if(man == 0 && *p == '0') continue;
+            if(digits++ < 19) man = man * 10 + (*p - '0');
+        }
+    }
+    if(!any) return false;
+    if(p < end && (*p | 0x20) == 'e') {
+        bool neg = false;
+        if(++p < end && (*p == '+' || *p == '-')) neg = *p++ == '-';
+        if(p == end || !number_is_digit(*p)) return false;
+        // Anything past this is 0 or infinity anyway
+        int64_t e = 0;
+        for(; p < end && number_is_digit(*p); ++p) {
+            if(e < 100000) e = e * 10 + (*p - '0');
+        }
+        exp10 += neg ? -e : e;
+    }
+    if(p != end) return false;
+    if(digits > 19) {
+        *out = number_parse_slow(start, end);
+        return true;
+    }
+    if(man == 0) {
+        *out = 0;
+        return true;
+    }
+    // Clinger: man and 10^|exp10| are both exact, so a single rounding is the right one
+    if(man <= (1ull << 53) && exp10 >= -22 && exp10 <= 22) {
+        *out = exp10 < 0 ? (double)man / number_exact_pow10[-exp10] : (double)man * number_exact_pow10[exp10];
+        return true;
+    }
+    if(exp10 >= NUMBER_POW10_MIN && exp10 <= NUMBER_POW10_MAX && number_eisel_lemire(man, (int)exp10, out)) return true;
+    *out = number_parse_slow(start, end);
+    return true;
+}
+size_t number_format(double value, char buf[NUMBER_FORMAT_MAX]) {
+    if(isnan(value)) return (size_t)snprintf(buf, NUMBER_FORMAT_MAX, "NaN");
+    if(isinf(value)) return (size_t)snprintf(buf, NUMBER_FORMAT_MAX, value < 0 ? "-Infinity" : "Infinity");
+    // Covers -0 too
+    if(value == 0) return (size_t)snprintf(buf, NUMBER_FORMAT_MAX, "0");
+    if(value >= -9007199254740992.0 && value <= 9007199254740992.0 && value == (double)(int64_t)value) {
+        return (size_t)snprintf(buf, NUMBER_FORMAT_MAX, "%lld", (long long)value);
+    }
+    // Shortest [-]d.ddde[+-]x that reads back as value
+    char sci[NUMBER_FORMAT_MAX];
+    for(int precision = 0; precision < 17; ++precision) {
+        snprintf(sci, sizeof(sci), "%.*e", precision, value);
+        if(strtod(sci, NULL) == value) break;
+    }
+    const char* p = sci;
+    char* out = buf;
+    if(*p == '-') *out++ = *p++;
+    char digits[17];
+    int k = 0;
+    for(; *p != 'e'; ++p) {
+        if(*p != '.') digits[k++] = *p;
+    }
+    // value = 0.digits * 10^n
+    int n = atoi(p + 1) + 1;
+    if(k <= n && n <= 21) {
+        memcpy(out, digits, k);
+        out += k;
+        for(int i = k; i < n; ++i) *out++ = '0';
+    } else if(0 < n && n <= 21) {
+        memcpy(out, digits, n);
+        out += n;
+        *out++ = '.';
+        memcpy(out, digits + n, k - n);
+        out += k - n;
+    } else if(-6 < n && n <= 0) {
+        *out++ = '0';
+        *out++ = '.';
+        for(int i = n; i < 0; ++i) *out++ = '0';
+        memcpy(out, digits, k);
+        out += k;
+    } else {
+        *out++ = digits[0];
+        if(k > 1) {
+            *out++ = '.';
+            memcpy(out, digits + 1, k - 1);
+            out += k - 1;
+        }
+        out += snprintf(out, NUMBER_FORMAT_MAX - (out - buf), "e%c%d", n - 1 < 0 ? '-' : '+', abs(n - 1));
+    }
+    *out = '\0';
+    return out - buf;
+}
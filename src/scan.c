@@ -0,0 +1,106 @@
+#include "scan.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+static inline bool scan_is_space(uint8_t c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+static inline bool scan_is_line(uint8_t c) {
+    return c != '\n' && c != '\r';
+}
+static inline bool scan_is_word(uint8_t c) {
+    uint8_t lower = c | 0x20;
+    return (lower >= 'a' && lower <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+static inline bool scan_is_str(uint8_t c) {
+    return c != '"' && c != '\\' && c != '\n' && c != '\r' && c < 0x80;
+}
+#define SCAN_SCALAR(name, pred) \
+    static const char* name##_scalar(const char* p, const char* end) { \
+        while(p < end && pred((uint8_t)*p)) p++; \
+        return p; \
+    }
+SCAN_SCALAR(scan_skip_space, scan_is_space)
+SCAN_SCALAR(scan_skip_word, scan_is_word)
+SCAN_SCALAR(scan_skip_str, scan_is_str)
+SCAN_SCALAR(scan_skip_line, scan_is_line)
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+// The kernels below compute a mask of bytes that end the run.
+// Bytes >= 0x80 are negative as signed chars, which keeps them out of every range check.
+#define SCAN_KERNEL(name, width, vec, load, stop_mask, isa) \
+    __attribute__((target(isa))) \
+    static const char* name##_##width(const char* p, const char* end) { \
+        while(end - p >= width) { \
+            vec v = load((const vec*)p); \
+            uint32_t stop = stop_mask(v); \
+            if(stop) return p + __builtin_ctz(stop); \
+            p += width; \
+        } \
+        return name##_scalar(p, end); \
+    }
+
+// '\t'..'\r' is a contiguous range
+#define SCAN_SPACE_STOP(set1, cmpeq, cmpgt, vand, vor, movemask, full) \
+    ~(uint32_t)movemask(vor(cmpeq(v, set1(' ')), \
+        vand(cmpgt(v, set1('\t'-1)), cmpgt(set1('\r'+1), v)))) & full
+#define SCAN_WORD_STOP(set1, cmpeq, cmpgt, vand, vor, movemask, full) \
+    ~(uint32_t)movemask(vor(vor( \
+        vand(cmpgt(vor(v, set1(0x20)), set1('a'-1)), cmpgt(set1('z'+1), vor(v, set1(0x20)))), \
+        vand(cmpgt(v, set1('0'-1)), cmpgt(set1('9'+1), v))), \
+        cmpeq(v, set1('_')))) & full
+#define SCAN_STR_STOP(set1, cmpeq, vor, movemask) \
+    (uint32_t)movemask(vor(vor(vor(cmpeq(v, set1('"')), cmpeq(v, set1('\\'))), \
+                             vor(cmpeq(v, set1('\n')), cmpeq(v, set1('\r')))), v))
+#define SCAN_LINE_STOP(set1, cmpeq, vor, movemask) \
+    (uint32_t)movemask(vor(cmpeq(v, set1('\n')), cmpeq(v, set1('\r'))))
+
+#define SSE2_SPACE(v) SCAN_SPACE_STOP(_mm_set1_epi8, _mm_cmpeq_epi8, _mm_cmpgt_epi8, _mm_and_si128, _mm_or_si128, _mm_movemask_epi8, 0xFFFF)
+#define SSE2_WORD(v) SCAN_WORD_STOP(_mm_set1_epi8, _mm_cmpeq_epi8, _mm_cmpgt_epi8, _mm_and_si128, _mm_or_si128, _mm_movemask_epi8, 0xFFFF)
+#define SSE2_STR(v) SCAN_STR_STOP(_mm_set1_epi8, _mm_cmpeq_epi8, _mm_or_si128, _mm_movemask_epi8)
+#define SSE2_LINE(v) SCAN_LINE_STOP(_mm_set1_epi8, _mm_cmpeq_epi8, _mm_or_si128, _mm_movemask_epi8)
+SCAN_KERNEL(scan_skip_space, 16, __m128i, _mm_loadu_si128, SSE2_SPACE, "sse2")
+SCAN_KERNEL(scan_skip_word, 16, __m128i, _mm_loadu_si128, SSE2_WORD, "sse2")
+SCAN_KERNEL(scan_skip_str, 16, __m128i, _mm_loadu_si128, SSE2_STR, "sse2")
+SCAN_KERNEL(scan_skip_line, 16, __m128i, _mm_loadu_si128, SSE2_LINE, "sse2")
+
+#define AVX2_SPACE(v) SCAN_SPACE_STOP(_mm256_set1_epi8, _mm256_cmpeq_epi8, _mm256_cmpgt_epi8, _mm256_and_si256, _mm256_or_si256, _mm256_movemask_epi8, 0xFFFFFFFF)
+#define AVX2_WORD(v) SCAN_WORD_STOP(_mm256_set1_epi8, _mm256_cmpeq_epi8, _mm256_cmpgt_epi8, _mm256_and_si256, _mm256_or_si256, _mm256_movemask_epi8, 0xFFFFFFFF)
+#define AVX2_STR(v) SCAN_STR_STOP(_mm256_set1_epi8, _mm256_cmpeq_epi8, _mm256_or_si256, _mm256_movemask_epi8)
+#define AVX2_LINE(v) SCAN_LINE_STOP(_mm256_set1_epi8, _mm256_cmpeq_epi8, _mm256_or_si256, _mm256_movemask_epi8)
+SCAN_KERNEL(scan_skip_space, 32, __m256i, _mm256_loadu_si256, AVX2_SPACE, "avx2")
+SCAN_KERNEL(scan_skip_word, 32, __m256i, _mm256_loadu_si256, AVX2_WORD, "avx2")
+SCAN_KERNEL(scan_skip_str, 32, __m256i, _mm256_loadu_si256, AVX2_STR, "avx2")
+SCAN_KERNEL(scan_skip_line, 32, __m256i, _mm256_loadu_si256, AVX2_LINE, "avx2")
+
+// Every x86_64 CPU has SSE2
+#define SCAN_RESOLVE(name) (__builtin_cpu_supports("avx2") ? name##_32 : name##_16)
+#else
+#define SCAN_RESOLVE(name) name##_scalar
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+// Threads may race to resolve, they all store the same thing
+#define SCAN_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define SCAN_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#else
+#define SCAN_LOAD(x) (x)
+#define SCAN_STORE(x, v) ((x) = (v))
+#endif
+typedef const char* (*ScanFunc)(const char* p, const char* end);
+// Dispatch happens on the first call, after that it's just an indirect call
+#define SCAN_DISPATCH(name) \
+    static const char* name##_resolve(const char* p, const char* end); \
+    static ScanFunc name##_impl = name##_resolve; \
+    static const char* name##_resolve(const char* p, const char* end) { \
+        SCAN_STORE(name##_impl, SCAN_RESOLVE(name)); \
+        return SCAN_LOAD(name##_impl)(p, end); \
+    } \
+    const char* name(const char* p, const char* end) { \
+        return SCAN_LOAD(name##_impl)(p, end); \
+    }
+SCAN_DISPATCH(scan_skip_space)
+SCAN_DISPATCH(scan_skip_word)
+SCAN_DISPATCH(scan_skip_str)
+SCAN_DISPATCH(scan_skip_line)
@@ -0,0 +1,3 @@
+console.log(let, static, yield)
+console.log(true, false, null)
+console.log(1 + true, null + 1, "a" + null, "b" + false)
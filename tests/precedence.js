@@ -0,0 +1,11 @@
+console.log(1-2*3+4)
+console.log(10-4-3)
+console.log(100/10/5)
+console.log(2*3-4/2)
+console.log(1+2*3-4/2+5)
+console.log(8-2-1-1)
+console.log(64/4/2/2)
+console.log(2*3*4-5-6)
+console.log(1-2+3-4+5)
+console.log("a" + 1 + 2)
+console.log(1 + 2 + "a")
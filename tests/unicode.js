@@ -0,0 +1,3 @@
+console.log(é)
+console.log(café, 名前, x😀y)
+console.log("e=" + é)